@@ -0,0 +1,150 @@
+/* ---------------------------------------------------------------------
+ *                           allocguard.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Counts heap allocator calls once armed. The allocator
+ *              entry points (malloc, calloc, realloc, reallocarray,
+ *              free and the aligned ones) are interposed for the whole
+ *              process (libc included) and passed on to glibc's own
+ *              allocator. Only compiled in with ALLOC_GUARD, for the
+ *              room_temp-check binary of make check-alloc; needs glibc
+ *              and dynamic linking. Elsewhere the guard is not
+ *              available and the allocator is left alone.
+ * --------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "allocguard.h"
+
+#if defined(__GLIBC__) && defined(ALLOC_GUARD)
+
+extern void *__libc_malloc(size_t n);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t n);
+extern void *__libc_memalign(size_t align, size_t n);
+extern void *__libc_valloc(size_t n);
+extern void *__libc_pvalloc(size_t n);
+extern void __libc_free(void *p);
+
+static atomic_int armed;
+static atomic_ulong calls;
+
+static inline void count(void)
+{
+	if (atomic_load_explicit(&armed, memory_order_relaxed))
+		atomic_fetch_add_explicit(&calls, 1, memory_order_relaxed);
+}
+
+void *malloc(size_t n)
+{
+	count();
+	return __libc_malloc(n);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	count();
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t n)
+{
+	count();
+	return __libc_realloc(p, n);
+}
+
+void *reallocarray(void *p, size_t n, size_t size)
+{
+	count();
+	if (size && n > SIZE_MAX / size) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	return __libc_realloc(p, n * size);
+}
+
+void *memalign(size_t align, size_t n)
+{
+	count();
+	return __libc_memalign(align, n);
+}
+
+void *aligned_alloc(size_t align, size_t n)
+{
+	count();
+	return __libc_memalign(align, n);
+}
+
+int posix_memalign(void **pp, size_t align, size_t n)
+{
+	void *p;
+
+	count();
+	if (align % sizeof(void *) || (align & (align - 1)) || !align)
+		return EINVAL;
+	p = __libc_memalign(align, n);
+	if (!p)
+		return ENOMEM;
+	*pp = p;
+	return 0;
+}
+
+void *valloc(size_t n)
+{
+	count();
+	return __libc_valloc(n);
+}
+
+void *pvalloc(size_t n)
+{
+	count();
+	return __libc_pvalloc(n);
+}
+
+void free(void *p)
+{
+	if (p)
+		count();
+	__libc_free(p);
+}
+
+int alloc_guard_available(void)
+{
+	return 1;
+}
+
+void alloc_guard_arm(void)
+{
+	atomic_store(&calls, 0);
+	atomic_store(&armed, 1);
+}
+
+unsigned long alloc_guard_disarm(void)
+{
+	atomic_store(&armed, 0);
+	return atomic_load(&calls);
+}
+
+#else
+
+int alloc_guard_available(void)
+{
+	return 0;
+}
+
+void alloc_guard_arm(void)
+{
+}
+
+unsigned long alloc_guard_disarm(void)
+{
+	return 0;
+}
+
+#endif
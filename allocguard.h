@@ -0,0 +1,19 @@
+/* ---------------------------------------------------------------------
+ *                           allocguard.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Counts heap allocator calls once armed, to check that
+ *              the steady state of the sampling loop allocates nothing
+ * --------------------------------------------------------------------*/
+
+#ifndef ALLOCGUARD_H
+#define ALLOCGUARD_H
+
+int alloc_guard_available(void);
+void alloc_guard_arm(void);
+unsigned long alloc_guard_disarm(void);     ///< calls since armed
+
+#endif /* ALLOCGUARD_H */
@@ -0,0 +1,70 @@
+/* ---------------------------------------------------------------------
+ *                           arena.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Bump allocator for the state that lives as long as the
+ *              process. Everything is allocated while setting up, in
+ *              blocks of at least ARENA_BLOCK straight from mmap(2), and
+ *              never given back, so the sampling loop never calls the
+ *              heap allocator and memory stays flat however long it
+ *              runs. Nothing is freed on its own: the blocks go with
+ *              the process.
+ * --------------------------------------------------------------------*/
+
+#include <sys/mman.h>
+
+#include "arena.h"
+
+static unsigned char *cur;          // current block
+static size_t cur_size, cur_used;
+static size_t total_size, total_used;
+
+static int arena_block(size_t n)
+{
+	size_t size = n > ARENA_BLOCK ? n : ARENA_BLOCK;
+	void *p;
+
+	size = (size + ARENA_BLOCK - 1) & ~(size_t)(ARENA_BLOCK - 1);
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return -1;
+	cur = p;
+	cur_size = size;
+	cur_used = 0;
+	total_size += size;
+	return 0;
+}
+
+int arena_reserve(size_t n)
+{
+	if (cur && cur_size - cur_used >= n)
+		return 0;
+	return arena_block(n);
+}
+
+void *arena_alloc(size_t n)
+{
+	void *p;
+
+	n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if (arena_reserve(n) < 0)
+		return NULL;
+	// mmap memory is zeroed and never reused
+	p = cur + cur_used;
+	cur_used += n;
+	total_used += n;
+	return p;
+}
+
+size_t arena_used(void)
+{
+	return total_used;
+}
+
+size_t arena_size(void)
+{
+	return total_size;
+}
@@ -0,0 +1,26 @@
+/* ---------------------------------------------------------------------
+ *                           arena.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Bump allocator for the state that lives as long as the
+ *              process (sensors, histograms, queues). Set-up only,
+ *              from one thread
+ * --------------------------------------------------------------------*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGN         64      ///< cache line
+#define ARENA_BLOCK         (1 << 20)
+
+void *arena_alloc(size_t n);        ///< zeroed, ARENA_ALIGN aligned; NULL if out of memory
+int arena_reserve(size_t n);        ///< the next n bytes without another block
+size_t arena_used(void);
+size_t arena_size(void);
+
+#endif /* ARENA_H */
@@ -0,0 +1,280 @@
+/* ---------------------------------------------------------------------
+ *                           bus.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Timed wrappers around the SMBus transactions and waits
+ *              used by the sensor drivers. Every transaction and sleep
+ *              is accounted in the latency histograms of the sensor
+ *              that owns the file descriptor. Transactions can be
+ *              recorded to, or replayed from, a transcript (trace.c).
+ * --------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#if defined(INTERNAL_SMBUS)
+#include "smbus.h"
+#else
+#include <i2c/smbus.h>
+#endif
+
+#include "arena.h"
+#include "bus.h"
+#include "probes.h"
+#include "profile.h"
+#include "sim.h"
+#include "trace.h"
+
+#if defined(HAVE_SDT)
+PROBE_SEMAPHORE(xfer);
+PROBE_SEMAPHORE(wait);
+PROBE_SEMAPHORE(sample);
+#endif
+
+struct bus_dev {
+	struct lat_sensor *lat;
+	struct sim_dev *sim;
+};
+
+static struct bus_dev *bus_devs;    // indexed by file descriptor
+static int bus_ndevs;
+static struct bus_dev *bus_sims;    // by handle - BUS_SIM_BASE
+static int bus_nsims, bus_sims_cap;
+
+static struct bus_dev *bus_dev(int file)
+{
+	if (file >= BUS_SIM_BASE)
+		return file - BUS_SIM_BASE < bus_nsims ? &bus_sims[file - BUS_SIM_BASE] : NULL;
+	return file >= 0 && file < bus_ndevs ? &bus_devs[file] : NULL;
+}
+
+int bus_open(const char *path, int addr, const char *name)
+{
+	struct lat_sensor *ls;
+	int file;
+
+	// a replay only needs a descriptor to key the sensor on
+	if (trace_mode == TRACE_REPLAY)
+		file = open("/dev/null", O_RDONLY);
+	else
+		file = open(path, O_RDWR);
+	if (file < 0) {
+		fprintf(stderr, "Error: Could not open file `%s': %s\n", path, strerror(errno));
+		if (errno == EACCES)
+			fprintf(stderr, "Run as root?\n");
+		return -1;
+	}
+	prof_mark(PROF_OPEN);
+	if (trace_mode != TRACE_REPLAY && ioctl(file, I2C_SLAVE, addr) < 0) {
+		fprintf(stderr,
+			"Error: Could not set address to 0x%02x: %s\n",
+			addr, strerror(errno));
+		close(file);
+		return -1;
+	}
+	prof_mark(PROF_IOCTL);
+	ls = arena_alloc(sizeof(*ls));
+	if (!ls) {
+		fprintf(stderr, "Error: out of memory\n");
+		close(file);
+		return -1;
+	}
+	if (file >= bus_ndevs) {
+		struct bus_dev *devs = realloc(bus_devs, (file + 1) * sizeof(*devs));
+
+		if (!devs) {
+			fprintf(stderr, "Error: out of memory\n");
+			close(file);
+			return -1;
+		}
+		memset(devs + bus_ndevs, 0, (file + 1 - bus_ndevs) * sizeof(*devs));
+		bus_devs = devs;
+		bus_ndevs = file + 1;
+	}
+	lat_register(ls, name, addr);
+	bus_devs[file].lat = ls;
+	return file;
+}
+
+// Emulated devices (sim.c) get handles from BUS_SIM_BASE up instead of
+// file descriptors, so there can be many more of them than open files.
+// Room for n of them is reserved up front.
+int bus_sim_reserve(uint32_t n)
+{
+	if (n > BUS_SIM_MAX || !(bus_sims = arena_alloc(n * sizeof(*bus_sims)))) {
+		fprintf(stderr, "Error: out of memory\n");
+		return -1;
+	}
+	bus_sims_cap = n;
+	return 0;
+}
+
+int bus_open_sim(enum sensor_type type, int addr, const char *name)
+{
+	struct lat_sensor *ls;
+	struct sim_dev *sim;
+
+	if (bus_nsims == bus_sims_cap) {
+		fprintf(stderr, "Error: too many emulated sensors\n");
+		return -1;
+	}
+	ls = arena_alloc(sizeof(*ls));
+	sim = sim_new(type, bus_nsims + 1);
+	if (!ls || !sim) {
+		fprintf(stderr, "Error: out of memory\n");
+		return -1;
+	}
+	lat_register(ls, name, addr);
+	bus_sims[bus_nsims].lat = ls;
+	bus_sims[bus_nsims].sim = sim;
+	return BUS_SIM_BASE + bus_nsims++;
+}
+
+void bus_close(int file)
+{
+	struct bus_dev *dev = bus_dev(file);
+
+	// the histograms stay registered, so they can still be dumped;
+	// they and the emulated device stay in the arena
+	if (dev) {
+		dev->lat = NULL;
+		dev->sim = NULL;
+	}
+	if (file < BUS_SIM_BASE)
+		close(file);
+}
+
+struct lat_sensor *bus_lat(int file)
+{
+	struct bus_dev *dev = bus_dev(file);
+
+	return dev ? dev->lat : NULL;
+}
+
+int bus_addr(int file)
+{
+	struct lat_sensor *ls = bus_lat(file);
+
+	return ls ? ls->addr : -1;
+}
+
+// returns the recorded duration in ns
+uint64_t bus_record(int file, enum lat_phase phase, uint64_t since)
+{
+	struct lat_sensor *ls = bus_lat(file);
+	uint64_t dt = lat_now() - since;
+
+	if (ls)
+		lat_record(&ls->phase[phase], dt);
+	return dt;
+}
+
+static int32_t bus_sim_xfer(int file, enum probe_op op, uint8_t cmd, uint8_t len,
+			    const uint8_t *wr, uint8_t *rd)
+{
+	struct bus_dev *dev = bus_dev(file);
+
+	return dev && dev->sim ? sim_xfer(dev->sim, op, cmd, len, wr, rd) : -EBADF;
+}
+
+// len/wr/rd: the bytes written or read, for the transcript
+#define BUS_TIMED(file, op, cmd, len, wr, rd, call)		\
+	do {							\
+		uint64_t t0 = lat_now(), dt;			\
+		int32_t res;					\
+		if (trace_mode == TRACE_REPLAY)			\
+			res = trace_replay(bus_addr(file), op, cmd, len, wr, rd); \
+		else if (file >= BUS_SIM_BASE)			\
+			res = bus_sim_xfer(file, op, cmd, len, wr, rd); \
+		else						\
+			res = (call);				\
+		dt = bus_record(file, LAT_XFER, t0);		\
+		if (trace_mode == TRACE_RECORD)			\
+			trace_xfer(bus_addr(file), op, cmd, len, wr, rd, res); \
+		if (PROBE_ENABLED(xfer))			\
+			PROBE5(xfer, bus_addr(file), op, cmd, res, dt); \
+		return res;					\
+	} while (0)
+
+int32_t bus_read_byte(int file)
+{
+	BUS_TIMED(file, PROBE_OP_READ_BYTE, 0, 0, NULL, NULL,
+		  i2c_smbus_read_byte(file));
+}
+
+int32_t bus_write_byte(int file, uint8_t value)
+{
+	BUS_TIMED(file, PROBE_OP_WRITE_BYTE, value, 0, NULL, NULL,
+		  i2c_smbus_write_byte(file, value));
+}
+
+int32_t bus_read_byte_data(int file, uint8_t cmd)
+{
+	BUS_TIMED(file, PROBE_OP_READ_BYTE_DATA, cmd, 0, NULL, NULL,
+		  i2c_smbus_read_byte_data(file, cmd));
+}
+
+int32_t bus_write_byte_data(int file, uint8_t cmd, uint8_t value)
+{
+	BUS_TIMED(file, PROBE_OP_WRITE_BYTE_DATA, cmd, 1, &value, NULL,
+		  i2c_smbus_write_byte_data(file, cmd, value));
+}
+
+int32_t bus_read_word_data(int file, uint8_t cmd)
+{
+	BUS_TIMED(file, PROBE_OP_READ_WORD_DATA, cmd, 0, NULL, NULL,
+		  i2c_smbus_read_word_data(file, cmd));
+}
+
+int32_t bus_read_i2c_block_data(int file, uint8_t cmd, uint8_t len, uint8_t *values)
+{
+	BUS_TIMED(file, PROBE_OP_READ_BLOCK, cmd, len, NULL, values,
+		  i2c_smbus_read_i2c_block_data(file, cmd, len, values));
+}
+
+int32_t bus_write_i2c_block_data(int file, uint8_t cmd, uint8_t len, const uint8_t *values)
+{
+	BUS_TIMED(file, PROBE_OP_WRITE_BLOCK, cmd, len, values, NULL,
+		  i2c_smbus_write_i2c_block_data(file, cmd, len, values));
+}
+
+// sleep the full period even if a signal (e.g. SIGUSR1) interrupts it
+void bus_usleep(int file, unsigned usec)
+{
+	uint64_t t0 = lat_now();
+	struct timespec req = { usec / 1000000, (usec % 1000000) * 1000L };
+	uint64_t dt;
+
+	// replays run at full speed
+	while (trace_mode != TRACE_REPLAY &&
+	       nanosleep(&req, &req) < 0 && errno == EINTR)
+		;
+	dt = bus_record(file, LAT_SLEEP, t0);
+	if (PROBE_ENABLED(wait))
+		PROBE5(wait, bus_addr(file), 0, usec, 0, dt);
+}
+
+void bus_wait_done(int file, int retries, int result, uint64_t since)
+{
+	uint64_t dt = bus_record(file, LAT_WAIT, since);
+
+	if (PROBE_ENABLED(wait))
+		PROBE5(wait, bus_addr(file), 1, retries, result, dt);
+}
+
+void bus_sample_done(int file, int result, uint64_t since)
+{
+	uint64_t dt = bus_record(file, LAT_SAMPLE, since);
+
+	if (PROBE_ENABLED(sample))
+		PROBE3(sample, bus_addr(file), result, dt);
+}
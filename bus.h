@@ -0,0 +1,43 @@
+/* ---------------------------------------------------------------------
+ *                           bus.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Timed wrappers around the SMBus transactions and waits
+ *              used by the sensor drivers
+ * --------------------------------------------------------------------*/
+
+#ifndef BUS_H
+#define BUS_H
+
+#include <stdint.h>
+
+#include "latency.h"
+#include "raw.h"
+
+#define BUS_SIM_BASE        (1 << 24)   ///< first handle of an emulated device
+#define BUS_SIM_MAX         (1 << 20)
+
+int bus_open(const char *path, int addr, const char *name);
+int bus_sim_reserve(uint32_t n);
+int bus_open_sim(enum sensor_type type, int addr, const char *name);
+void bus_close(int file);
+struct lat_sensor *bus_lat(int file);
+int bus_addr(int file);
+
+int32_t bus_read_byte(int file);
+int32_t bus_write_byte(int file, uint8_t value);
+int32_t bus_read_byte_data(int file, uint8_t cmd);
+int32_t bus_write_byte_data(int file, uint8_t cmd, uint8_t value);
+int32_t bus_read_word_data(int file, uint8_t cmd);
+int32_t bus_read_i2c_block_data(int file, uint8_t cmd, uint8_t len, uint8_t *values);
+int32_t bus_write_i2c_block_data(int file, uint8_t cmd, uint8_t len, const uint8_t *values);
+
+void bus_usleep(int file, unsigned usec);
+uint64_t bus_record(int file, enum lat_phase phase, uint64_t since);
+void bus_wait_done(int file, int retries, int result, uint64_t since);
+void bus_sample_done(int file, int result, uint64_t since);
+
+#endif /* BUS_H */
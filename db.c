@@ -0,0 +1,283 @@
+/* ---------------------------------------------------------------------
+ *                           db.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: SQLite sink, for sites that want SQL on the readings.
+ *              One table, indexed on (sensor, ts), in WAL mode so that
+ *              readers and the writer do not block each other. Rows are
+ *              inserted through one prepared statement and committed in
+ *              batches: a transaction per row costs a WAL sync per row,
+ *              a batch costs one for all of them (make bench-sqlite).
+ *              Built with make SQLITE=1; without it --sqlite reports
+ *              that it is not there.
+ * --------------------------------------------------------------------*/
+
+#include <unistd.h>
+
+#include "db.h"
+#include "latency.h"
+#include "raw.h"
+
+#if defined(HAVE_SQLITE)
+
+#include <sqlite3.h>
+
+#define DB_COMMIT_TRIES     3       ///< failed COMMITs before a rollback
+
+static const char schema[] =
+	"CREATE TABLE IF NOT EXISTS readings ("
+	" ts INTEGER NOT NULL,"         // CLOCK_REALTIME, ns
+	" sensor INTEGER NOT NULL,"     // sensor index
+	" addr INTEGER NOT NULL,"
+	" model TEXT NOT NULL,"
+	" temp REAL,"                   // NULL if not measured
+	" humi REAL,"
+	" status INTEGER NOT NULL);"    // valid quantities, -1: failed
+	"CREATE INDEX IF NOT EXISTS readings_sensor_ts ON readings (sensor, ts);";
+
+static sqlite3 *db;
+static sqlite3_stmt *ins, *begin, *commit;
+static const char *db_path;
+static uint32_t batch_n, batch_ms;
+static uint32_t pending;                // rows in the open transaction
+static uint64_t first_pending;          // monotonic ns, when it began
+static int in_txn;
+static int commit_fails;                // in a row, for the open transaction
+
+static const char *const model_names[SENSOR_TYPES] = {
+	[SENSOR_NONE]    = "FUSED",
+	[SENSOR_MCP9801] = "MCP9801",
+	[SENSOR_AHT10]   = "AHT10",
+	[SENSOR_SHT30]   = "SHT30",
+};
+
+static int db_err(const char *what)
+{
+	fprintf(stderr, "Error: SQLite %s `%s': %s\n", what, db_path,
+		db ? sqlite3_errmsg(db) : "out of memory");
+	return -1;
+}
+
+int db_available(void)
+{
+	return 1;
+}
+
+int db_open(const char *path, uint32_t n, uint32_t ms)
+{
+	db_path = path;
+	batch_n = n;
+	batch_ms = ms;
+	pending = 0;
+	first_pending = 0;
+	in_txn = 0;
+	commit_fails = 0;
+	if (sqlite3_open(path, &db) != SQLITE_OK) {
+		db_err("open");
+		sqlite3_close(db);
+		db = NULL;
+		return -1;
+	}
+	// another process reading, or checkpointing, holds a lock briefly
+	sqlite3_busy_timeout(db, 1000);
+	// FULL syncs the WAL at every commit, so a batch is as durable as
+	// a journal group commit; without batches nothing is synced
+	if (sqlite3_exec(db, "PRAGMA journal_mode=WAL", NULL, NULL, NULL) != SQLITE_OK ||
+	    sqlite3_exec(db, n ? "PRAGMA synchronous=FULL" : "PRAGMA synchronous=OFF",
+			 NULL, NULL, NULL) != SQLITE_OK ||
+	    sqlite3_exec(db, schema, NULL, NULL, NULL) != SQLITE_OK ||
+	    sqlite3_prepare_v2(db, "INSERT INTO readings VALUES (?, ?, ?, ?, ?, ?, ?)",
+			       -1, &ins, NULL) != SQLITE_OK ||
+	    sqlite3_prepare_v2(db, "BEGIN", -1, &begin, NULL) != SQLITE_OK ||
+	    sqlite3_prepare_v2(db, "COMMIT", -1, &commit, NULL) != SQLITE_OK) {
+		db_err("set-up of");
+		db_close();
+		return -1;
+	}
+	return 0;
+}
+
+static int db_step(sqlite3_stmt *st, const char *what)
+{
+	int res = sqlite3_step(st);
+
+	sqlite3_reset(st);
+	return res == SQLITE_DONE ? 0 : db_err(what);
+}
+
+void db_append(const struct jrec *r)
+{
+	if (!db)
+		return;
+	if (!in_txn) {
+		if (db_step(begin, "begin on") < 0)
+			return;
+		in_txn = 1;
+	}
+	sqlite3_bind_int64(ins, 1, r->ts);
+	sqlite3_bind_int(ins, 2, r->id);
+	sqlite3_bind_int(ins, 3, r->addr);
+	sqlite3_bind_text(ins, 4, r->type < SENSOR_TYPES && model_names[r->type] ?
+			  model_names[r->type] : "unknown", -1, SQLITE_STATIC);
+	if (r->status > 0 && (r->status & 0x01))
+		sqlite3_bind_double(ins, 5, r->temp);
+	else
+		sqlite3_bind_null(ins, 5);
+	if (r->status > 0 && (r->status & 0x02))
+		sqlite3_bind_double(ins, 6, r->humi);
+	else
+		sqlite3_bind_null(ins, 6);
+	sqlite3_bind_int(ins, 7, r->status);
+	if (db_step(ins, "insert into") == 0)
+		pending++;
+}
+
+/* Commits the open transaction. A failed COMMIT (busy beyond the
+   timeout) leaves it open: it is tried again with the next check, and
+   after DB_COMMIT_TRIES rolled back. If SQLite rolled it back itself
+   (I/O error, disk full), the rows are gone right away. Either way the
+   next row starts a new transaction. */
+static int db_end(void)
+{
+	int res = sqlite3_step(commit);
+
+	sqlite3_reset(commit);
+	if (res == SQLITE_DONE) {
+		in_txn = 0;
+		pending = 0;
+		first_pending = 0;
+		commit_fails = 0;
+		return 0;
+	}
+	db_err("commit on");
+	first_pending = 0;
+	if (!sqlite3_get_autocommit(db) && ++commit_fails < DB_COMMIT_TRIES)
+		return -1;
+	if (!sqlite3_get_autocommit(db) &&
+	    sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL) != SQLITE_OK)
+		db_err("rollback on");
+	fprintf(stderr, "Error: SQLite %u rows not written to `%s'\n",
+		pending, db_path);
+	in_txn = 0;
+	pending = 0;
+	commit_fails = 0;
+	return -1;
+}
+
+// commits the open transaction if it is time
+int db_commit(uint64_t now)
+{
+	if (!in_txn)
+		return 0;
+	if (!first_pending)
+		first_pending = now;
+	if (!(batch_n && pending >= batch_n) &&
+	    !(batch_ms && now - first_pending >= batch_ms * 1000000ull))
+		return 0;
+	return db_end();
+}
+
+uint64_t db_commit_due(void)
+{
+	if (!in_txn || !batch_ms || !first_pending)
+		return 0;
+	return first_pending + batch_ms * 1000000ull;
+}
+
+void db_close(void)
+{
+	if (!db)
+		return;
+	// tried until committed or rolled back
+	while (in_txn)
+		db_end();
+	sqlite3_finalize(ins);
+	sqlite3_finalize(begin);
+	sqlite3_finalize(commit);
+	ins = begin = commit = NULL;
+	sqlite3_close(db);
+	db = NULL;
+}
+
+// Inserts n readings, one commit check per reading as in continuous
+// mode, per row and in batches, into a scratch database in dir
+void db_bench(FILE *f, size_t n, const char *dir)
+{
+	static const uint32_t batch[] = { 1, 16, 256, 4096 };
+	struct jrec r = { .addr = 0x44, .type = SENSOR_SHT30, .status = 3, .humi = 50.0f };
+	char path[4096], side[4096 + 8];
+	unsigned b;
+
+	snprintf(path, sizeof(path), "%s/room_temp-bench.db", dir);
+	for (b = 0; b < sizeof(batch) / sizeof(batch[0]); b++) {
+		uint64_t t0, dt;
+		size_t i;
+
+		unlink(path);
+		snprintf(side, sizeof(side), "%s-wal", path);
+		unlink(side);
+		if (db_open(path, batch[b], 0) < 0)
+			return;
+		t0 = lat_now();
+		for (i = 0; i < n; i++) {
+			r.ts = t0 + i;
+			r.id = i % 8;
+			r.temp = 20.0f + (i % 100) * 0.01f;
+			db_append(&r);
+			db_commit(lat_now());
+		}
+		db_close();
+		dt = lat_now() - t0;
+		fprintf(f, "%4u rows/transaction %10.0f inserts/s, %.1f us/insert\n",
+			batch[b], n * 1e9 / dt, dt / 1e3 / n);
+	}
+	unlink(path);
+}
+
+#else
+
+int db_available(void)
+{
+	return 0;
+}
+
+int db_open(const char *path, uint32_t n, uint32_t ms)
+{
+	(void)n;
+	(void)ms;
+	fprintf(stderr, "Error: Could not open `%s': built without SQLite "
+		"(make SQLITE=1)\n", path);
+	return -1;
+}
+
+void db_append(const struct jrec *r)
+{
+	(void)r;
+}
+
+int db_commit(uint64_t now)
+{
+	(void)now;
+	return 0;
+}
+
+uint64_t db_commit_due(void)
+{
+	return 0;
+}
+
+void db_close(void)
+{
+}
+
+void db_bench(FILE *f, size_t n, const char *dir)
+{
+	(void)n;
+	(void)dir;
+	fprintf(f, "Built without SQLite (make SQLITE=1)\n");
+}
+
+#endif
@@ -0,0 +1,34 @@
+/* ---------------------------------------------------------------------
+ *                           db.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: SQLite sink for readings: WAL mode, one transaction per
+ *              batch of readings (make SQLITE=1)
+ * --------------------------------------------------------------------*/
+
+#ifndef DB_H
+#define DB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "journal.h"
+
+int db_available(void);             ///< built with SQLite
+
+// A transaction is committed once batch_n readings or batch_ms ms have
+// gathered since it began, as the group commit of struct journal:
+// batch_n 0 commits by time only, and without syncing.
+int db_open(const char *path, uint32_t batch_n, uint32_t batch_ms);
+void db_append(const struct jrec *r);
+int db_commit(uint64_t now);
+uint64_t db_commit_due(void);       ///< monotonic ns, 0: nothing pending
+void db_close(void);
+
+void db_bench(FILE *f, size_t n, const char *dir);
+
+#endif /* DB_H */
@@ -0,0 +1,393 @@
+/* ---------------------------------------------------------------------
+ *                           decode.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Batch decoding of 6-byte AHT10 and SHT30 measurement
+ *              frames to deg C and %RH. The scalar kernels are plain
+ *              branch-free loops the compiler can vectorise; on x86
+ *              SSSE3 kernels are picked at runtime, on 64 bit ARM the
+ *              SHT30 kernel uses NEON. SHT30 counts are converted in
+ *              double like the driver always did (see raw.h), so every
+ *              kernel gives the same floats as it; decode_bench()
+ *              checks that over all counts.
+ * --------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DECODE_SSSE3
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define DECODE_NEON
+#endif
+
+#include "decode.h"
+#include "latency.h"
+#include "raw.h"
+
+// Counts are at most 20 bits, so converting them as signed (which SSE
+// can do in one instruction) gives the same floats as unsigned would.
+
+static void aht10_scalar(const uint8_t *p, size_t n, float *temp, float *humi)
+{
+	const struct raw_scale sc = raw_scales[SENSOR_AHT10];
+	size_t i;
+
+	for (i = 0; i < n; i++, p += FRAME_LEN) {
+		uint32_t t, h;
+
+		decode_aht10(p, &t, &h);
+		temp[i] = sc.t_off + sc.t_scale * (float)(int32_t)t;
+		humi[i] = sc.h_off + sc.h_scale * (float)(int32_t)h;
+	}
+}
+
+static void sht30_scalar(const uint8_t *p, size_t n, float *temp, float *humi)
+{
+	const struct raw_scale sc = raw_scales[SENSOR_SHT30];
+	size_t i;
+
+	for (i = 0; i < n; i++, p += FRAME_LEN) {
+		uint32_t t, h;
+
+		decode_sht30(p, &t, &h);
+		temp[i] = sc.t_off + sc.t_mul * t / sc.div;
+		humi[i] = sc.h_off + sc.h_mul * h / sc.div;
+	}
+}
+
+#if defined(DECODE_SSSE3)
+
+// Four frames per iteration, from two overlapping 16 byte loads at
+// frame 0 and frame 2. pshufb moves the big endian fields of two
+// frames into little endian 32 bit lanes (-1 clears a byte); the
+// second load reads 4 bytes past the 4 frames, hence i + 5 <= n.
+#define SHUF(a, b, c, d, e, f, g, h) \
+	_mm_setr_epi8(a, b, c, d, e, f, g, h, -1, -1, -1, -1, -1, -1, -1, -1)
+#define SHUF_HI(a, b, c, d, e, f, g, h) \
+	_mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, a, b, c, d, e, f, g, h)
+
+__attribute__((target("ssse3")))
+static void aht10_ssse3(const uint8_t *p, size_t n, float *temp, float *humi)
+{
+	const struct raw_scale sc = raw_scales[SENSOR_AHT10];
+	// bytes 3..1 >> 4 is the humidity, bytes 5..3 & 0xfffff the temperature
+	const __m128i h_lo = SHUF(3, 2, 1, -1, 9, 8, 7, -1);
+	const __m128i h_hi = SHUF_HI(3, 2, 1, -1, 9, 8, 7, -1);
+	const __m128i t_lo = SHUF(5, 4, 3, -1, 11, 10, 9, -1);
+	const __m128i t_hi = SHUF_HI(5, 4, 3, -1, 11, 10, 9, -1);
+	const __m128i t_mask = _mm_set1_epi32(0xfffff);
+	const __m128 t_off = _mm_set1_ps(sc.t_off), t_scale = _mm_set1_ps(sc.t_scale);
+	const __m128 h_off = _mm_set1_ps(sc.h_off), h_scale = _mm_set1_ps(sc.h_scale);
+	size_t i = 0;
+
+	for (; i + 5 <= n; i += 4, p += 4 * FRAME_LEN) {
+		__m128i a = _mm_loadu_si128((const __m128i *)p);
+		__m128i b = _mm_loadu_si128((const __m128i *)(p + 2 * FRAME_LEN));
+		__m128i t = _mm_or_si128(_mm_shuffle_epi8(a, t_lo), _mm_shuffle_epi8(b, t_hi));
+		__m128i h = _mm_or_si128(_mm_shuffle_epi8(a, h_lo), _mm_shuffle_epi8(b, h_hi));
+
+		t = _mm_and_si128(t, t_mask);
+		h = _mm_srli_epi32(h, 4);
+		_mm_storeu_ps(temp + i, _mm_add_ps(t_off, _mm_mul_ps(t_scale, _mm_cvtepi32_ps(t))));
+		_mm_storeu_ps(humi + i, _mm_add_ps(h_off, _mm_mul_ps(h_scale, _mm_cvtepi32_ps(h))));
+	}
+	aht10_scalar(p, n - i, temp + i, humi + i);
+}
+
+// off + mul * count / div of four counts, in double two at a time
+__attribute__((target("ssse3")))
+static inline __m128 sht30_pd(__m128i c, __m128d off, __m128d mul, __m128d div)
+{
+	__m128d lo = _mm_cvtepi32_pd(c), hi = _mm_cvtepi32_pd(_mm_srli_si128(c, 8));
+
+	lo = _mm_add_pd(off, _mm_div_pd(_mm_mul_pd(mul, lo), div));
+	hi = _mm_add_pd(off, _mm_div_pd(_mm_mul_pd(mul, hi), div));
+	return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+
+__attribute__((target("ssse3")))
+static void sht30_ssse3(const uint8_t *p, size_t n, float *temp, float *humi)
+{
+	const struct raw_scale sc = raw_scales[SENSOR_SHT30];
+	const __m128i t_lo = SHUF(1, 0, -1, -1, 7, 6, -1, -1);
+	const __m128i t_hi = SHUF_HI(1, 0, -1, -1, 7, 6, -1, -1);
+	const __m128i h_lo = SHUF(4, 3, -1, -1, 10, 9, -1, -1);
+	const __m128i h_hi = SHUF_HI(4, 3, -1, -1, 10, 9, -1, -1);
+	const __m128d t_off = _mm_set1_pd(sc.t_off), t_mul = _mm_set1_pd(sc.t_mul);
+	const __m128d h_off = _mm_set1_pd(sc.h_off), h_mul = _mm_set1_pd(sc.h_mul);
+	const __m128d div = _mm_set1_pd(sc.div);
+	size_t i = 0;
+
+	for (; i + 5 <= n; i += 4, p += 4 * FRAME_LEN) {
+		__m128i a = _mm_loadu_si128((const __m128i *)p);
+		__m128i b = _mm_loadu_si128((const __m128i *)(p + 2 * FRAME_LEN));
+		__m128i t = _mm_or_si128(_mm_shuffle_epi8(a, t_lo), _mm_shuffle_epi8(b, t_hi));
+		__m128i h = _mm_or_si128(_mm_shuffle_epi8(a, h_lo), _mm_shuffle_epi8(b, h_hi));
+
+		_mm_storeu_ps(temp + i, sht30_pd(t, t_off, t_mul, div));
+		_mm_storeu_ps(humi + i, sht30_pd(h, h_off, h_mul, div));
+	}
+	sht30_scalar(p, n - i, temp + i, humi + i);
+}
+
+static int have_ssse3(void)
+{
+	return __builtin_cpu_supports("ssse3");
+}
+
+#elif defined(DECODE_NEON)
+
+// off + mul * count / div of four counts (exact as floats), in double
+// two at a time
+static inline float32x4_t sht30_f64(uint16x4_t c, float64x2_t off, double mul,
+				     float64x2_t div)
+{
+	float32x4_t f = vcvtq_f32_u32(vmovl_u16(c));
+	float64x2_t lo = vaddq_f64(off, vdivq_f64(vmulq_n_f64(vcvt_f64_f32(vget_low_f32(f)), mul), div));
+	float64x2_t hi = vaddq_f64(off, vdivq_f64(vmulq_n_f64(vcvt_high_f64_f32(f), mul), div));
+
+	return vcvt_high_f32_f64(vcvt_f32_f64(lo), hi);
+}
+
+// Eight frames per iteration: vld3 splits 48 bytes into byte triples,
+// so val[0]/val[1] hold the high/low bytes of T0 H0 T1 H1 ... and
+// vuzp separates the temperatures from the humidities.
+static void sht30_neon(const uint8_t *p, size_t n, float *temp, float *humi)
+{
+	const struct raw_scale sc = raw_scales[SENSOR_SHT30];
+	const float64x2_t t_off = vdupq_n_f64(sc.t_off), h_off = vdupq_n_f64(sc.h_off);
+	const float64x2_t div = vdupq_n_f64(sc.div);
+	size_t i = 0;
+
+	for (; i + 8 <= n; i += 8, p += 8 * FRAME_LEN) {
+		uint8x16x3_t v = vld3q_u8(p);
+		uint16x8_t lo = vorrq_u16(vshll_n_u8(vget_low_u8(v.val[0]), 8),
+					  vmovl_u8(vget_low_u8(v.val[1])));
+		uint16x8_t hi = vorrq_u16(vshll_n_u8(vget_high_u8(v.val[0]), 8),
+					  vmovl_u8(vget_high_u8(v.val[1])));
+		uint16x8x2_t th = vuzpq_u16(lo, hi);
+
+		vst1q_f32(temp + i, sht30_f64(vget_low_u16(th.val[0]), t_off, sc.t_mul, div));
+		vst1q_f32(temp + i + 4, sht30_f64(vget_high_u16(th.val[0]), t_off, sc.t_mul, div));
+		vst1q_f32(humi + i, sht30_f64(vget_low_u16(th.val[1]), h_off, sc.h_mul, div));
+		vst1q_f32(humi + i + 4, sht30_f64(vget_high_u16(th.val[1]), h_off, sc.h_mul, div));
+	}
+	sht30_scalar(p, n - i, temp + i, humi + i);
+}
+
+#endif
+
+void decode_aht10_batch(const uint8_t *frames, size_t n, float *temp, float *humi)
+{
+#if defined(DECODE_SSSE3)
+	if (have_ssse3()) {
+		aht10_ssse3(frames, n, temp, humi);
+		return;
+	}
+#endif
+	aht10_scalar(frames, n, temp, humi);
+}
+
+void decode_sht30_batch(const uint8_t *frames, size_t n, float *temp, float *humi)
+{
+#if defined(DECODE_SSSE3)
+	if (have_ssse3()) {
+		sht30_ssse3(frames, n, temp, humi);
+		return;
+	}
+#elif defined(DECODE_NEON)
+	sht30_neon(frames, n, temp, humi);
+	return;
+#endif
+	sht30_scalar(frames, n, temp, humi);
+}
+
+// One frame at a time through raw_temp()/raw_humi(), like the drivers
+static void aht10_single(const uint8_t *p, size_t n, float *temp, float *humi)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++, p += FRAME_LEN) {
+		uint32_t t, h;
+
+		decode_aht10(p, &t, &h);
+		temp[i] = raw_temp(SENSOR_AHT10, t);
+		humi[i] = raw_humi(SENSOR_AHT10, h);
+	}
+}
+
+static void sht30_single(const uint8_t *p, size_t n, float *temp, float *humi)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++, p += FRAME_LEN) {
+		uint32_t t, h;
+
+		decode_sht30(p, &t, &h);
+		temp[i] = raw_temp(SENSOR_SHT30, t);
+		humi[i] = raw_humi(SENSOR_SHT30, h);
+	}
+}
+
+typedef void (*decode_fn)(const uint8_t *p, size_t n, float *temp, float *humi);
+
+static const struct {
+	const char *name;
+	decode_fn fn;
+	decode_fn ref;
+} bench_kernels[] = {
+	{ "aht10 single", aht10_single,       aht10_single },
+	{ "aht10 scalar", aht10_scalar,       aht10_single },
+	{ "aht10 batch",  decode_aht10_batch, aht10_single },
+	{ "sht30 single", sht30_single,       sht30_single },
+	{ "sht30 scalar", sht30_scalar,       sht30_single },
+	{ "sht30 batch",  decode_sht30_batch, sht30_single },
+};
+
+// the conversions of the original drivers, as they were written
+static float aht10_temp_orig(uint32_t c)
+{
+	return ((float)c * 200 / 0x100000) - 50;
+}
+
+static float aht10_humi_orig(uint32_t c)
+{
+	return ((float)c * 100) / 0x100000;
+}
+
+static float sht30_temp_orig(uint32_t c)
+{
+	return -45 + (175 * (float)c / 65535.0);
+}
+
+static float sht30_humi_orig(uint32_t c)
+{
+	return 100 * (float)c / 65535.0;
+}
+
+static const struct {
+	const char *name;
+	enum sensor_type type;
+	uint32_t counts;
+	decode_fn batch;
+	float (*temp)(uint32_t c);
+	float (*humi)(uint32_t c);
+} orig_checks[] = {
+	{ "aht10", SENSOR_AHT10, 1u << 20, decode_aht10_batch, aht10_temp_orig, aht10_humi_orig },
+	{ "sht30", SENSOR_SHT30, 1u << 16, decode_sht30_batch, sht30_temp_orig, sht30_humi_orig },
+};
+
+// Every count through raw_temp()/raw_humi(), raw_convert() (--convert)
+// and the batch kernel, against the original driver; equal floats print
+// the same
+static void check_orig(FILE *f, unsigned k)
+{
+	uint32_t c, n = orig_checks[k].counts;
+	uint8_t *frames = malloc((size_t)n * FRAME_LEN);
+	struct raw_rec *rec = malloc(n * sizeof(*rec));
+	float *bt = malloc(n * sizeof(float)), *bh = malloc(n * sizeof(float));
+	float *ct = malloc(n * sizeof(float)), *ch = malloc(n * sizeof(float));
+	size_t bad = 0;
+
+	if (!frames || !rec || !bt || !bh || !ct || !ch) {
+		fprintf(stderr, "Error: out of memory\n");
+		bad = n;
+		goto out;
+	}
+	for (c = 0; c < n; c++) {
+		uint8_t *p = frames + (size_t)c * FRAME_LEN;
+
+		// the same count as temperature and humidity
+		memset(p, 0, FRAME_LEN);
+		if (orig_checks[k].type == SENSOR_AHT10) {
+			p[1] = c >> 12;
+			p[2] = c >> 4;
+			p[3] = (c & 0x0f) << 4 | c >> 16;
+			p[4] = c >> 8;
+			p[5] = c;
+		} else {
+			p[0] = p[3] = c >> 8;
+			p[1] = p[4] = c;
+		}
+		raw_pack(&rec[c], 0, 0, orig_checks[k].type, 3, c, c);
+	}
+	orig_checks[k].batch(frames, n, bt, bh);
+	raw_convert(rec, n, ct, ch);
+	for (c = 0; c < n; c++) {
+		float t = orig_checks[k].temp(c), h = orig_checks[k].humi(c);
+
+		if (raw_temp(orig_checks[k].type, c) != t || raw_humi(orig_checks[k].type, c) != h ||
+		    bt[c] != t || bh[c] != h || ct[c] != t || ch[c] != h)
+			bad++;
+	}
+	fprintf(f, "%-14s %u counts, %zu differ from the original driver\n",
+		orig_checks[k].name, n, bad);
+out:
+	free(frames);
+	free(rec);
+	free(bt);
+	free(bh);
+	free(ct);
+	free(ch);
+}
+
+// Each kernel runs over the same n frames for at least 200 ms; the
+// batch kernels are checked against the single-frame path, and all of
+// them against the original drivers.
+void decode_bench(FILE *f, size_t n)
+{
+	uint8_t *frames = malloc(n * FRAME_LEN);
+	float *temp = malloc(n * sizeof(float)), *humi = malloc(n * sizeof(float));
+	float *rtemp = malloc(n * sizeof(float)), *rhumi = malloc(n * sizeof(float));
+	uint32_t seed = 12345;
+	unsigned k;
+	size_t i;
+
+	if (!frames || !temp || !humi || !rtemp || !rhumi) {
+		fprintf(stderr, "Error: out of memory\n");
+		goto out;
+	}
+	for (i = 0; i < n * FRAME_LEN; i++) {
+		seed = seed * 1103515245u + 12345u;
+		frames[i] = seed >> 24;
+	}
+#if defined(DECODE_SSSE3)
+	fprintf(f, "batch kernels: %s\n", have_ssse3() ? "ssse3" : "scalar");
+#elif defined(DECODE_NEON)
+	fprintf(f, "batch kernels: neon (sht30)\n");
+#endif
+	for (k = 0; k < sizeof(bench_kernels) / sizeof(bench_kernels[0]); k++) {
+		uint64_t t0 = lat_now(), dt;
+		size_t frames_done = 0, bad = 0;
+
+		do {
+			bench_kernels[k].fn(frames, n, temp, humi);
+			frames_done += n;
+			dt = lat_now() - t0;
+		} while (dt < 200000000u);
+
+		bench_kernels[k].ref(frames, n, rtemp, rhumi);
+		for (i = 0; i < n; i++)
+			if (temp[i] != rtemp[i] || humi[i] != rhumi[i])
+				bad++;
+		fprintf(f, "%-14s %8.1f Mframes/s", bench_kernels[k].name,
+			frames_done * 1e3 / dt);
+		if (bad)
+			fprintf(f, "  (%zu of %zu differ)", bad, n);
+		fprintf(f, "\n");
+	}
+	for (k = 0; k < sizeof(orig_checks) / sizeof(orig_checks[0]); k++)
+		check_orig(f, k);
+out:
+	free(frames);
+	free(temp);
+	free(humi);
+	free(rtemp);
+	free(rhumi);
+}
@@ -0,0 +1,44 @@
+/* ---------------------------------------------------------------------
+ *                           decode.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Unpacking of the 6-byte AHT10 and SHT30 measurement
+ *              frames, one at a time (drivers) or in batches (logs,
+ *              replays)
+ * --------------------------------------------------------------------*/
+
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define FRAME_LEN           6
+
+// AHT10: status, 20 bit humidity, 20 bit temperature, big endian
+static inline void decode_aht10(const uint8_t *d, uint32_t *t, uint32_t *h)
+{
+	*h = (uint32_t)d[1] << 12 | (uint32_t)d[2] << 4 | d[3] >> 4;
+	*t = (uint32_t)(d[3] & 0x0f) << 16 | (uint32_t)d[4] << 8 | d[5];
+}
+
+// SHT30: 16 bit temperature, CRC, 16 bit humidity, CRC, big endian
+static inline void decode_sht30(const uint8_t *d, uint32_t *t, uint32_t *h)
+{
+	*t = (uint32_t)d[0] << 8 | d[1];
+	*h = (uint32_t)d[3] << 8 | d[4];
+}
+
+// Batch decode of n frames (n * FRAME_LEN bytes) straight to deg C and
+// %RH, using SSSE3 or NEON where available
+void decode_aht10_batch(const uint8_t *frames, size_t n, float *temp, float *humi);
+void decode_sht30_batch(const uint8_t *frames, size_t n, float *temp, float *humi);
+
+// frames/s of the scalar and batch decoders over n synthetic frames
+void decode_bench(FILE *f, size_t n);
+
+#endif /* DECODE_H */
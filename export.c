@@ -0,0 +1,680 @@
+/* ---------------------------------------------------------------------
+ *                           export.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Columnar export of readings for analytics, as an Arrow
+ *              IPC file (Feather v2): columns ts (timestamp, ns, UTC),
+ *              sensor (dictionary of "MODEL@0xADDR#ID"), temp and humi
+ *              (float32, null where not measured), with --derived also
+ *              dew, ah, humidex, heat_index and vpd. pyarrow/pandas map
+ *              it and use the arrays as they are, nothing is parsed:
+ *
+ *                pandas.read_feather("room.arrow")
+ *                pyarrow.ipc.open_file(pyarrow.memory_map("room.arrow"))
+ *
+ *              The readings are streamed out in record batches of
+ *              EXPORT_BATCH rows, so memory stays the same however long
+ *              the history; only the sensor dictionary (sent as deltas
+ *              when new sensors show up) and the footer's list of
+ *              batches (24 bytes per batch) grow. The metadata are
+ *              flatbuffers, built here by hand; values are in host byte
+ *              order, which the format wants little-endian.
+ * --------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "export.h"
+
+#define EXPORT_BATCH        65536   ///< rows per record batch
+#define ARROW_MAGIC         "ARROW1"
+#define ARROW_V5            4       ///< MetadataVersion
+#define FB_MSG_MAX          4096    ///< metadata of a message, at most
+
+enum arrow_header {
+	HDR_SCHEMA = 1,
+	HDR_DICTIONARY = 2,
+	HDR_RECORD_BATCH = 3,
+};
+
+enum arrow_type {
+	TYPE_INT = 2,
+	TYPE_FLOAT = 3,
+	TYPE_UTF8 = 5,
+	TYPE_TIMESTAMP = 10,
+};
+
+static const struct column {
+	const char *name;
+	uint8_t nullable;
+	uint8_t type;           ///< enum arrow_type; TYPE_UTF8: the dictionary
+} columns[] = {
+	{ "ts",     0, TYPE_TIMESTAMP },
+	{ "sensor", 0, TYPE_UTF8 },
+	{ "temp",   1, TYPE_FLOAT },
+	{ "humi",   1, TYPE_FLOAT },
+	// struct psychro, --derived
+	{ "dew",        1, TYPE_FLOAT },
+	{ "ah",         1, TYPE_FLOAT },
+	{ "humidex",    1, TYPE_FLOAT },
+	{ "heat_index", 1, TYPE_FLOAT },
+	{ "vpd",        1, TYPE_FLOAT },
+};
+
+#define NCOLUMNS            (sizeof(columns) / sizeof(columns[0]))
+#define NVALUES             (NCOLUMNS - 2)  ///< the float columns
+#define NBASIC              4               ///< without --derived
+
+/* flatbuffers, built front to back: a table goes out before the objects
+   it refers to, and its offsets are patched in as they follow (they
+   only point forward) */
+
+struct fb {
+	unsigned char *p;       ///< zeroed, cap bytes
+	size_t len, cap;
+};
+
+static size_t fb_grow(struct fb *b, size_t n)
+{
+	size_t at = b->len;
+
+	b->len += n;
+	return at;
+}
+
+static void fb_pad(struct fb *b, size_t align)
+{
+	b->len = (b->len + align - 1) / align * align;
+}
+
+static void put8(struct fb *b, size_t at, uint8_t v)
+{
+	b->p[at] = v;
+}
+
+static void put16(struct fb *b, size_t at, uint16_t v)
+{
+	memcpy(b->p + at, &v, sizeof(v));
+}
+
+static void put32(struct fb *b, size_t at, uint32_t v)
+{
+	memcpy(b->p + at, &v, sizeof(v));
+}
+
+static void put64(struct fb *b, size_t at, uint64_t v)
+{
+	memcpy(b->p + at, &v, sizeof(v));
+}
+
+static void fb_ref(struct fb *b, size_t at, size_t target)
+{
+	put32(b, at, target - at);
+}
+
+// A table of n fields, size[i] bytes each (0: absent), its vtable
+// right before it. Returns where it is; pos[i]: where field i is.
+static size_t fb_table(struct fb *b, int n, const uint8_t *size, size_t *pos)
+{
+	size_t off = 4, fo[8], vt, t;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		fo[i] = 0;
+		if (!size[i])
+			continue;
+		off = (off + size[i] - 1) / size[i] * size[i];
+		fo[i] = off;
+		off += size[i];
+	}
+	fb_pad(b, 2);
+	vt = fb_grow(b, 4 + 2 * n);
+	put16(b, vt, 4 + 2 * n);
+	put16(b, vt + 2, off);
+	for (i = 0; i < n; i++)
+		put16(b, vt + 4 + 2 * i, fo[i]);
+	fb_pad(b, 8);
+	t = fb_grow(b, off);
+	put32(b, t, t - vt);
+	for (i = 0; i < n; i++)
+		pos[i] = t + fo[i];
+	return t;
+}
+
+static size_t fb_string(struct fb *b, const char *s)
+{
+	size_t n = strlen(s), at;
+
+	fb_pad(b, 4);
+	at = fb_grow(b, 4 + n + 1);
+	put32(b, at, n);
+	memcpy(b->p + at + 4, s, n);
+	return at;
+}
+
+// a vector of n elements of esize bytes, aligned to align
+static size_t fb_vector(struct fb *b, size_t n, size_t esize, size_t align)
+{
+	size_t at;
+
+	while ((b->len + 4) % align)
+		b->len++;
+	at = fb_grow(b, 4 + n * esize);
+	put32(b, at, n);
+	return at;
+}
+
+static size_t fb_int(struct fb *b, int bits, int is_signed)
+{
+	static const uint8_t sz[] = { 4, 1 };
+	size_t pos[2], t = fb_table(b, 2, sz, pos);
+
+	put32(b, pos[0], bits);
+	put8(b, pos[1], is_signed);
+	return t;
+}
+
+static size_t fb_field(struct fb *b, const struct column *c)
+{
+	const uint8_t sz[] = { 4, 1, 1, 4, c->type == TYPE_UTF8 ? 4 : 0, 4 };
+	size_t pos[6], tpos[2], t, ty;
+
+	t = fb_table(b, 6, sz, pos);
+	fb_ref(b, pos[0], fb_string(b, c->name));
+	put8(b, pos[1], c->nullable);
+	put8(b, pos[2], c->type);
+	switch (c->type) {
+	case TYPE_TIMESTAMP: {
+		static const uint8_t tsz[] = { 2, 4 };
+
+		ty = fb_table(b, 2, tsz, tpos);
+		put16(b, tpos[0], 3);       // NANOSECOND
+		fb_ref(b, tpos[1], fb_string(b, "UTC"));
+		break;
+	}
+	case TYPE_FLOAT: {
+		static const uint8_t fsz[] = { 2 };
+
+		ty = fb_table(b, 1, fsz, tpos);
+		put16(b, tpos[0], 1);       // SINGLE
+		break;
+	}
+	default:
+		ty = fb_table(b, 0, NULL, NULL);
+		break;
+	}
+	fb_ref(b, pos[3], ty);
+	if (c->type == TYPE_UTF8) {
+		// DictionaryEncoding: id 0, int32 indices
+		static const uint8_t dsz[] = { 8, 4, 1 };
+		size_t dpos[3], d = fb_table(b, 3, dsz, dpos);
+
+		fb_ref(b, pos[4], d);
+		fb_ref(b, dpos[1], fb_int(b, 32, 1));
+	}
+	fb_ref(b, pos[5], fb_vector(b, 0, 4, 4));  // children, none
+	return t;
+}
+
+static size_t ncolumns;         ///< NBASIC or NCOLUMNS
+
+static size_t fb_schema(struct fb *b)
+{
+	static const uint8_t sz[] = { 2, 4 };
+	size_t pos[2], t, v, i;
+
+	t = fb_table(b, 2, sz, pos);
+	v = fb_vector(b, ncolumns, 4, 4);
+	fb_ref(b, pos[1], v);
+	for (i = 0; i < ncolumns; i++)
+		fb_ref(b, v + 4 + 4 * i, fb_field(b, &columns[i]));
+	return t;
+}
+
+// the root Message; *hdr: where the header table goes
+static void fb_message(struct fb *b, uint8_t type, uint64_t body_len, size_t *hdr)
+{
+	static const uint8_t sz[] = { 2, 1, 4, 8 };
+	size_t pos[4], t;
+
+	fb_grow(b, 4);
+	t = fb_table(b, 4, sz, pos);
+	fb_ref(b, 0, t);
+	put16(b, pos[0], ARROW_V5);
+	put8(b, pos[1], type);
+	put64(b, pos[3], body_len);
+	*hdr = pos[2];
+}
+
+struct arrow_node {
+	int64_t length, null_count;
+};
+
+struct arrow_buffer {
+	int64_t offset, length;
+};
+
+static size_t fb_batch(struct fb *b, int64_t rows, const struct arrow_node *nodes,
+		       size_t nnodes, const struct arrow_buffer *bufs, size_t nbufs)
+{
+	static const uint8_t sz[] = { 8, 4, 4 };
+	size_t pos[3], t, v;
+
+	t = fb_table(b, 3, sz, pos);
+	put64(b, pos[0], rows);
+	v = fb_vector(b, nnodes, sizeof(*nodes), 8);
+	memcpy(b->p + v + 4, nodes, nnodes * sizeof(*nodes));
+	fb_ref(b, pos[1], v);
+	v = fb_vector(b, nbufs, sizeof(*bufs), 8);
+	memcpy(b->p + v + 4, bufs, nbufs * sizeof(*bufs));
+	fb_ref(b, pos[2], v);
+	return t;
+}
+
+/* the file */
+
+struct arrow_block {
+	int64_t offset;
+	int32_t meta_len;
+	int32_t pad;
+	int64_t body_len;
+};
+
+struct part {
+	const void *p;
+	size_t len;
+};
+
+static FILE *f;
+static const char *path;
+static uint64_t fpos;
+static int werr;
+
+// the current batch
+static int64_t *ts;
+static int32_t *idx;
+static float *val[NVALUES];     ///< temp, humi, dew, ..
+static uint8_t *valid[NVALUES];
+static size_t rows;
+
+// sensor dictionary: (id, addr, type) -> index, labels
+static uint64_t *dkeys;         // key + 1, 0: empty slot
+static int32_t *dvals;
+static size_t dcap;
+static char *labels;
+static int32_t *label_off;      // dict_n + 1
+static size_t labels_cap, dict_cap, dict_n, dict_sent;
+
+static struct arrow_block *dict_blocks, *batch_blocks;
+static size_t ndict_blocks, nbatch_blocks;
+
+static size_t pad8(size_t n)
+{
+	return (n + 7) & ~(size_t)7;
+}
+
+static void fwrite_all(const void *p, size_t n)
+{
+	if (n && fwrite(p, 1, n, f) != n)
+		werr = 1;
+	fpos += n;
+}
+
+static void fwrite_pad(size_t n)
+{
+	static const char zero[8];
+
+	fwrite_all(zero, pad8(n) - n);
+}
+
+static int add_block(struct arrow_block **v, size_t *n, const struct arrow_block *blk)
+{
+	// one per EXPORT_BATCH rows: grown in steps
+	if (*n % 256 == 0) {
+		struct arrow_block *nv = realloc(*v, (*n + 256) * sizeof(**v));
+
+		if (!nv)
+			return -1;
+		*v = nv;
+	}
+	(*v)[(*n)++] = *blk;
+	return 0;
+}
+
+// an encapsulated message: marker, metadata size, metadata, body
+static void write_message(struct fb *b, const struct part *body, size_t nparts,
+			  struct arrow_block *blk)
+{
+	uint32_t hdr[2] = { 0xffffffffu, 0 };
+	size_t i;
+
+	fb_pad(b, 8);
+	hdr[1] = b->len;
+	blk->offset = fpos;
+	blk->meta_len = sizeof(hdr) + b->len;
+	blk->pad = 0;
+	blk->body_len = 0;
+	fwrite_all(hdr, sizeof(hdr));
+	fwrite_all(b->p, b->len);
+	for (i = 0; i < nparts; i++) {
+		fwrite_all(body[i].p, body[i].len);
+		fwrite_pad(body[i].len);
+		blk->body_len += pad8(body[i].len);
+	}
+}
+
+static uint64_t body_length(const struct part *body, size_t nparts)
+{
+	uint64_t n = 0;
+	size_t i;
+
+	for (i = 0; i < nparts; i++)
+		n += pad8(body[i].len);
+	return n;
+}
+
+// the buffers of the body parts, at their offsets (a 0-length part is
+// a validity buffer left out: no nulls)
+static void body_buffers(const struct part *body, size_t nparts, struct arrow_buffer *bufs)
+{
+	int64_t off = 0;
+	size_t i;
+
+	for (i = 0; i < nparts; i++) {
+		bufs[i].offset = off;
+		bufs[i].length = body[i].len;
+		off += pad8(body[i].len);
+	}
+}
+
+static void write_schema(void)
+{
+	unsigned char mem[FB_MSG_MAX] = { 0 };
+	struct fb b = { mem, 0, sizeof(mem) };
+	struct arrow_block blk;
+	size_t hdr;
+
+	fb_message(&b, HDR_SCHEMA, 0, &hdr);
+	fb_ref(&b, hdr, fb_schema(&b));
+	write_message(&b, NULL, 0, &blk);
+}
+
+// the sensors that turned up since the last one, as a delta
+static void write_dictionary(void)
+{
+	unsigned char mem[FB_MSG_MAX] = { 0 };
+	struct fb b = { mem, 0, sizeof(mem) };
+	static const uint8_t sz[] = { 8, 4, 1 };
+	size_t m = dict_n - dict_sent, i, hdr, pos[3], t;
+	int32_t *off = malloc((m + 1) * sizeof(*off));
+	struct arrow_node node = { m, 0 };
+	struct arrow_buffer bufs[3];
+	struct part body[3];
+	struct arrow_block blk;
+
+	if (!off) {
+		werr = 1;
+		return;
+	}
+	for (i = 0; i <= m; i++)
+		off[i] = label_off[dict_sent + i] - label_off[dict_sent];
+	body[0] = (struct part){ NULL, 0 };
+	body[1] = (struct part){ off, (m + 1) * sizeof(*off) };
+	body[2] = (struct part){ labels + label_off[dict_sent], off[m] };
+	body_buffers(body, 3, bufs);
+
+	fb_message(&b, HDR_DICTIONARY, body_length(body, 3), &hdr);
+	t = fb_table(&b, 3, sz, pos);
+	fb_ref(&b, hdr, t);
+	put8(&b, pos[2], dict_sent > 0);    // isDelta
+	fb_ref(&b, pos[1], fb_batch(&b, m, &node, 1, bufs, 3));
+	write_message(&b, body, 3, &blk);
+	free(off);
+	if (add_block(&dict_blocks, &ndict_blocks, &blk) < 0)
+		werr = 1;
+	dict_sent = dict_n;
+}
+
+static int64_t null_count(const uint8_t *valid, size_t n)
+{
+	int64_t nulls = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		nulls += !(valid[i / 8] & (1 << (i % 8)));
+	return nulls;
+}
+
+static void write_batch(void)
+{
+	unsigned char mem[FB_MSG_MAX] = { 0 };
+	struct fb b = { mem, 0, sizeof(mem) };
+	size_t bm = (rows + 7) / 8, hdr, nparts = 2 * ncolumns, i;
+	struct arrow_node nodes[NCOLUMNS] = { { rows, 0 }, { rows, 0 } };
+	struct part body[2 * NCOLUMNS] = {
+		{ NULL, 0 },   { ts, rows * sizeof(*ts) },
+		{ NULL, 0 },   { idx, rows * sizeof(*idx) },
+	};
+	struct arrow_buffer bufs[2 * NCOLUMNS];
+	struct arrow_block blk;
+
+	if (rows == 0)
+		return;
+	if (dict_n > dict_sent)
+		write_dictionary();
+	for (i = 0; i < ncolumns - 2; i++) {
+		nodes[2 + i] = (struct arrow_node){ rows, null_count(valid[i], rows) };
+		body[4 + 2 * i] = (struct part){ valid[i], bm };
+		body[5 + 2 * i] = (struct part){ val[i], rows * sizeof(*val[i]) };
+	}
+	body_buffers(body, nparts, bufs);
+	fb_message(&b, HDR_RECORD_BATCH, body_length(body, nparts), &hdr);
+	fb_ref(&b, hdr, fb_batch(&b, rows, nodes, ncolumns, bufs, nparts));
+	write_message(&b, body, nparts, &blk);
+	if (add_block(&batch_blocks, &nbatch_blocks, &blk) < 0)
+		werr = 1;
+	for (i = 0; i < ncolumns - 2; i++)
+		memset(valid[i], 0, EXPORT_BATCH / 8);
+	rows = 0;
+}
+
+static uint64_t hash(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdull;
+	return k ^ (k >> 33);
+}
+
+static int dict_grow(void)
+{
+	size_t ncap = dcap ? 2 * dcap : 64, i;
+	uint64_t *nk = calloc(ncap, sizeof(*nk));
+	int32_t *nv = malloc(ncap * sizeof(*nv));
+
+	if (!nk || !nv) {
+		free(nk);
+		free(nv);
+		return -1;
+	}
+	for (i = 0; i < dcap; i++) {
+		size_t j;
+
+		if (!dkeys[i])
+			continue;
+		for (j = hash(dkeys[i]) & (ncap - 1); nk[j]; j = (j + 1) & (ncap - 1))
+			;
+		nk[j] = dkeys[i];
+		nv[j] = dvals[i];
+	}
+	free(dkeys);
+	free(dvals);
+	dkeys = nk;
+	dvals = nv;
+	dcap = ncap;
+	return 0;
+}
+
+// the dictionary index of the sensor of s, -1 if out of memory
+static int32_t dict_index(const struct sample *s)
+{
+	uint64_t key = ((uint64_t)s->id << 16 | s->addr << 8 | s->type) + 1;
+	char label[64];
+	size_t j, n;
+
+	if (2 * (dict_n + 1) > dcap && dict_grow() < 0)
+		return -1;
+	for (j = hash(key) & (dcap - 1); dkeys[j]; j = (j + 1) & (dcap - 1))
+		if (dkeys[j] == key)
+			return dvals[j];
+
+	n = snprintf(label, sizeof(label), "%s@0x%02x#%u", s->sensor, s->addr, s->id);
+	if (dict_n + 2 > dict_cap) {
+		int32_t *no = realloc(label_off, 2 * (dict_n + 2) * sizeof(*no));
+
+		if (!no)
+			return -1;
+		label_off = no;
+		dict_cap = 2 * (dict_n + 2);
+	}
+	if (label_off[dict_n] + n > labels_cap) {
+		char *nl = realloc(labels, 2 * (labels_cap + n));
+
+		if (!nl)
+			return -1;
+		labels = nl;
+		labels_cap = 2 * (labels_cap + n);
+	}
+	memcpy(labels + label_off[dict_n], label, n);
+	label_off[dict_n + 1] = label_off[dict_n] + n;
+	dkeys[j] = key;
+	dvals[j] = dict_n;
+	return dict_n++;
+}
+
+int export_open(const char *p, int derived)
+{
+	static const char magic[8] = ARROW_MAGIC;
+	int nomem;
+	size_t i;
+
+	path = p;
+	ncolumns = derived ? NCOLUMNS : NBASIC;
+	ts = malloc(EXPORT_BATCH * sizeof(*ts));
+	idx = malloc(EXPORT_BATCH * sizeof(*idx));
+	label_off = calloc(1, sizeof(*label_off));
+	dict_cap = 1;
+	nomem = !ts || !idx || !label_off;
+	for (i = 0; i < ncolumns - 2; i++) {
+		val[i] = malloc(EXPORT_BATCH * sizeof(*val[i]));
+		valid[i] = calloc(EXPORT_BATCH / 8, 1);
+		nomem |= !val[i] || !valid[i];
+	}
+	if (nomem) {
+		fprintf(stderr, "Error: out of memory\n");
+		return -1;
+	}
+	f = fopen(path, "wb");
+	if (!f) {
+		fprintf(stderr, "Error: Could not open `%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+	fwrite_all(magic, sizeof(magic));
+	write_schema();
+	return 0;
+}
+
+void export_sample(const struct sample *s)
+{
+	int good = s->status > 0;
+	int32_t i = dict_index(s);
+	size_t k;
+
+	if (i < 0) {
+		werr = 1;
+		return;
+	}
+	ts[rows] = s->ts;
+	idx[rows] = i;
+	val[0][rows] = good && (s->status & 0x01) ? s->temp : 0;
+	val[1][rows] = good && (s->status & 0x02) ? s->humi : 0;
+	if (good && (s->status & 0x01))
+		valid[0][rows / 8] |= 1 << (rows % 8);
+	if (good && (s->status & 0x02))
+		valid[1][rows / 8] |= 1 << (rows % 8);
+	if (ncolumns > NBASIC) {
+		const float dp[] = {
+			s->dp.dew, s->dp.ah, s->dp.humidex, s->dp.heat_index, s->dp.vpd,
+		};
+
+		for (k = 0; k < NVALUES - 2; k++) {
+			val[2 + k][rows] = s->derived ? dp[k] : 0;
+			if (s->derived)
+				valid[2 + k][rows / 8] |= 1 << (rows % 8);
+		}
+	}
+	if (++rows == EXPORT_BATCH)
+		write_batch();
+}
+
+// the last batch, the end-of-stream marker and the footer
+int export_close(void)
+{
+	static const uint32_t eos[2] = { 0xffffffffu, 0 };
+	static const uint8_t sz[] = { 2, 4, 4, 4 };
+	struct fb b = { NULL, 0, 0 };
+	size_t pos[4], t, v, i;
+	uint32_t len;
+	int res = 0;
+
+	write_batch();
+	fwrite_all(eos, sizeof(eos));
+
+	b.cap = FB_MSG_MAX + (ndict_blocks + nbatch_blocks) * sizeof(struct arrow_block);
+	b.p = calloc(b.cap, 1);
+	if (!b.p) {
+		werr = 1;
+	} else {
+		fb_grow(&b, 4);
+		t = fb_table(&b, 4, sz, pos);
+		fb_ref(&b, 0, t);
+		put16(&b, pos[0], ARROW_V5);
+		fb_ref(&b, pos[1], fb_schema(&b));
+		v = fb_vector(&b, ndict_blocks, sizeof(struct arrow_block), 8);
+		if (ndict_blocks)
+			memcpy(b.p + v + 4, dict_blocks, ndict_blocks * sizeof(struct arrow_block));
+		fb_ref(&b, pos[2], v);
+		v = fb_vector(&b, nbatch_blocks, sizeof(struct arrow_block), 8);
+		if (nbatch_blocks)
+			memcpy(b.p + v + 4, batch_blocks, nbatch_blocks * sizeof(struct arrow_block));
+		fb_ref(&b, pos[3], v);
+		len = b.len;
+		fwrite_all(b.p, b.len);
+		fwrite_all(&len, sizeof(len));
+		fwrite_all(ARROW_MAGIC, strlen(ARROW_MAGIC));
+		free(b.p);
+	}
+	if (fclose(f) != 0 || werr) {
+		fprintf(stderr, "Error: Could not write `%s'\n", path);
+		res = -1;
+	}
+	free(ts);
+	free(idx);
+	for (i = 0; i < NVALUES; i++) {
+		free(val[i]);
+		free(valid[i]);
+		val[i] = NULL;
+		valid[i] = NULL;
+	}
+	free(dkeys);
+	free(dvals);
+	free(labels);
+	free(label_off);
+	free(dict_blocks);
+	free(batch_blocks);
+	return res;
+}
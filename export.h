@@ -0,0 +1,21 @@
+/* ---------------------------------------------------------------------
+ *                           export.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Columnar export of readings, as an Arrow IPC file
+ *              (Feather v2)
+ * --------------------------------------------------------------------*/
+
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "output.h"
+
+int export_open(const char *path, int derived);   ///< derived: the struct psychro columns too
+void export_sample(const struct sample *s);
+int export_close(void);             ///< 0, -1 if the file is not complete
+
+#endif /* EXPORT_H */
@@ -0,0 +1,132 @@
+/* ---------------------------------------------------------------------
+ *                           filter.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Smoothing filters between conversion and output:
+ *              exponential moving average and a 1-D Kalman filter.
+ *              The state lives across the readings of a continuous
+ *              run, and can be kept in a file across single runs.
+ * --------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+// spec: "ema:ALPHA" or "kalman:Q:R"; returns -1 if malformed
+int filter_parse(const char *spec, struct filter_cfg *cfg)
+{
+	char *end;
+
+	memset(cfg, 0, sizeof(*cfg));
+	if (!strncmp(spec, "ema:", 4)) {
+		cfg->kind = FILTER_EMA;
+		cfg->alpha = strtof(spec + 4, &end);
+		if (end == spec + 4 || *end || cfg->alpha <= 0 || cfg->alpha > 1)
+			return -1;
+		return 0;
+	}
+	if (!strncmp(spec, "kalman:", 7)) {
+		cfg->kind = FILTER_KALMAN;
+		cfg->q = strtof(spec + 7, &end);
+		if (end == spec + 7 || *end != ':' || cfg->q < 0)
+			return -1;
+		spec = end + 1;
+		cfg->r = strtof(spec, &end);
+		if (end == spec || *end || cfg->r <= 0)
+			return -1;
+		return 0;
+	}
+	if (!strcmp(spec, "none"))
+		return 0;
+	return -1;
+}
+
+// The Kalman filter models the quantity as a random walk: between two
+// readings its variance grows by q per second, so after a long gap
+// (e.g. between cron runs) a new reading weighs more, just as it should.
+float filter_apply(const struct filter_cfg *cfg, struct filter_state *st,
+		   float z, uint64_t ts)
+{
+	double dt, k;
+
+	if (cfg->kind == FILTER_NONE)
+		return z;
+	if (!st->init) {
+		st->init = 1;
+		st->x = z;
+		st->p = cfg->r;
+		st->ts = ts;
+		return z;
+	}
+
+	dt = ts > st->ts ? (ts - st->ts) / 1e9 : 0;
+	st->ts = ts;
+	switch (cfg->kind) {
+	case FILTER_EMA:
+		st->x += cfg->alpha * (z - st->x);
+		break;
+	case FILTER_KALMAN:
+		st->p += cfg->q * dt;
+		k = st->p / (st->p + cfg->r);
+		st->x += k * (z - st->x);
+		st->p *= 1 - k;
+		break;
+	default:
+		break;
+	}
+	return st->x;
+}
+
+// state file: one line per quantity (temp, humi): "init x p ts"
+int filter_load(const char *path, struct filter_state st[2])
+{
+	FILE *f = fopen(path, "r");
+	int i, ok = 0;
+
+	memset(st, 0, 2 * sizeof(*st));
+	if (!f)
+		return -1;
+	for (i = 0; i < 2; i++) {
+		unsigned init;
+		unsigned long long ts;
+
+		if (fscanf(f, "%u %lf %lf %llu", &init, &st[i].x, &st[i].p, &ts) != 4)
+			break;
+		st[i].init = init;
+		st[i].ts = ts;
+		ok++;
+	}
+	fclose(f);
+	if (ok != 2) {
+		memset(st, 0, 2 * sizeof(*st));
+		return -1;
+	}
+	return 0;
+}
+
+// written to a temporary file and renamed, so a crash never leaves
+// a truncated state behind
+int filter_save(const char *path, const struct filter_state st[2])
+{
+	char tmp[4096];
+	FILE *f;
+	int i;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "w");
+	if (!f)
+		return -1;
+	for (i = 0; i < 2; i++)
+		fprintf(f, "%u %.17g %.17g %llu\n", st[i].init, st[i].x, st[i].p,
+			(unsigned long long)st[i].ts);
+	if (fclose(f) != 0 || rename(tmp, path) != 0) {
+		remove(tmp);
+		return -1;
+	}
+	return 0;
+}
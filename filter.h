@@ -0,0 +1,44 @@
+/* ---------------------------------------------------------------------
+ *                           filter.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Smoothing filters between conversion and output:
+ *              exponential moving average and a 1-D Kalman filter
+ * --------------------------------------------------------------------*/
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+
+enum filter_kind {
+	FILTER_NONE = 0,
+	FILTER_EMA,         ///< x += alpha * (z - x)
+	FILTER_KALMAN,      ///< random walk model, see filter.c
+};
+
+struct filter_cfg {
+	enum filter_kind kind;
+	float alpha;        ///< EMA weight of a new reading, 0..1
+	float q;            ///< Kalman process noise, variance per second
+	float r;            ///< Kalman measurement noise, variance
+};
+
+struct filter_state {
+	uint8_t init;
+	double x;           ///< estimate
+	double p;           ///< Kalman: variance of the estimate
+	uint64_t ts;        ///< time of the last update, ns
+};
+
+int filter_parse(const char *spec, struct filter_cfg *cfg);
+float filter_apply(const struct filter_cfg *cfg, struct filter_state *st,
+		   float z, uint64_t ts);
+
+int filter_load(const char *path, struct filter_state st[2]);
+int filter_save(const char *path, const struct filter_state st[2]);
+
+#endif /* FILTER_H */
@@ -0,0 +1,260 @@
+/* ---------------------------------------------------------------------
+ *                           fuse.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Fusion of redundant temperature sensors (--fuse). The
+ *              calibrated readings of a cycle are combined by their
+ *              weighted median, which a single wild reading cannot
+ *              pull away. To catch a sensor that drifts, every sensor
+ *              keeps a smoothed distance from the weighted median of
+ *              all of them, the drifting ones included (one reading
+ *              counts at most FUSE_CLAMP * tol, so a glitch alone does
+ *              not flag it). Against the median of all, the good
+ *              sensors stay close to 0 while the bad one carries the
+ *              whole fault; against the median of the others, each good
+ *              one would carry half of it too. A sensor is left out
+ *              once its distance exceeds tol, and only if it stands out
+ *              (FUSE_MARGIN times the runner-up, by weight) and the ones
+ *              left then agree within tol. After that nobody goes out
+ *              for FUSE_HOLD cycles, so one fault cannot take out two
+ *              sensors in a row. A sensor is back once it is within
+ *              tol / 2. With two sensors of the same weight there is no
+ *              telling which one drifts, so neither goes out and the
+ *              cycle is marked as a disagreement. fuse_check() runs a
+ *              step fault and a slow drift through all this.
+ * --------------------------------------------------------------------*/
+
+#include <math.h>
+
+#include "fuse.h"
+
+#define FUSE_ALPHA          0.1f    ///< smoothing of the distances
+#define FUSE_CLAMP          4       ///< a reading counts up to this * tol
+#define FUSE_MARGIN         2       ///< how far a sensor must stand out
+#define FUSE_HOLD           10      ///< cycles between two sensors left out
+
+float fuse_wmedian(float *v, float *w, int n)
+{
+	float total = 0, half, c = 0;
+	int i, j;
+
+	// a handful of sensors: insertion sort
+	for (i = 1; i < n; i++) {
+		float tv = v[i], tw = w[i];
+
+		for (j = i; j > 0 && v[j - 1] > tv; j--) {
+			v[j] = v[j - 1];
+			w[j] = w[j - 1];
+		}
+		v[j] = tv;
+		w[j] = tw;
+	}
+	for (i = 0; i < n; i++)
+		total += w[i];
+	half = total / 2;
+	for (i = 0; i < n - 1; i++) {
+		c += w[i];
+		if (c == half)
+			return (v[i] + v[i + 1]) / 2;
+		if (c > half)
+			return v[i];
+	}
+	return v[n - 1];
+}
+
+// the readings of the sensors in the fusion but skip, or with all of
+// them also the ones left out
+static int gather(const struct fusion *f, int skip, int all, float *v, float *w)
+{
+	int i, n = 0;
+
+	for (i = 0; i < f->n; i++) {
+		if (i == skip || !f->m[i].have || (f->m[i].drift && !all))
+			continue;
+		v[n] = f->m[i].temp;
+		w[n++] = f->m[i].weight;
+	}
+	return n;
+}
+
+// whether the sensors left in without skip agree within tol
+static int agree_without(const struct fusion *f, int skip)
+{
+	float v[FUSE_MAX], w[FUSE_MAX], lo, hi;
+	int i, n = gather(f, skip, 0, v, w);
+
+	if (!n)
+		return 0;
+	lo = hi = v[0];
+	for (i = 1; i < n; i++) {
+		lo = v[i] < lo ? v[i] : lo;
+		hi = v[i] > hi ? v[i] : hi;
+	}
+	return hi - lo <= f->tol;
+}
+
+int fuse_cycle(struct fusion *f, float *temp, float *sd)
+{
+	float v[FUSE_MAX], w[FUSE_MAX], best_score = 0, second = 0, sum = 0;
+	float ref, lim = FUSE_CLAMP * f->tol;
+	int i, n, best = -1;
+
+	for (i = 0; i < f->n; i++)
+		f->m[i].changed = 0;
+	if (f->hold)
+		f->hold--;
+
+	// how far each one is off the median of all
+	n = gather(f, -1, 1, v, w);
+	if (n > 1) {
+		ref = fuse_wmedian(v, w, n);
+		for (i = 0; i < f->n; i++) {
+			struct fuse_member *m = &f->m[i];
+			float d = m->temp - ref;
+
+			if (!m->have)
+				continue;
+			d = d > lim ? lim : d < -lim ? -lim : d;
+			m->dev += FUSE_ALPHA * (d - m->dev);
+		}
+	}
+
+	// back in; the one out, if any, furthest off for its weight
+	for (i = 0; i < f->n; i++) {
+		struct fuse_member *m = &f->m[i];
+		float score;
+
+		if (!m->have)
+			continue;
+		if (m->drift) {
+			if (fabsf(m->dev) < f->tol / 2) {
+				m->drift = 0;
+				m->changed = 1;
+			}
+			continue;
+		}
+		score = fabsf(m->dev) / m->weight;
+		if (score > best_score) {
+			second = best_score;
+			best_score = score;
+			best = i;
+		} else if (score > second) {
+			second = score;
+		}
+	}
+	if (best >= 0 && !f->hold && fabsf(f->m[best].dev) > f->tol &&
+	    best_score > FUSE_MARGIN * second && agree_without(f, best)) {
+		f->m[best].drift = 1;
+		f->m[best].changed = 1;
+		f->hold = FUSE_HOLD;
+	}
+
+	n = gather(f, -1, 0, v, w);
+	f->disagree = 0;
+	if (n) {
+		*temp = fuse_wmedian(v, w, n);
+		for (i = 0; i < n; i++)
+			sum += (v[i] - *temp) * (v[i] - *temp);
+		*sd = sqrtf(sum / n);
+		// sorted: the ones left in span more than tol
+		f->disagree = v[n - 1] - v[0] > f->tol;
+	}
+	for (i = 0; i < f->n; i++)
+		f->m[i].have = 0;
+	return n;
+}
+
+/* regression check */
+
+#define CHECK_CYCLES        200
+#define CHECK_FAULT_AT      10      ///< cycle the fault starts
+#define CHECK_TEMP          25.0f
+
+struct fuse_case {
+	const char *name;
+	int n;
+	float weight[3];
+	int bad;                ///< the faulty sensor
+	float step, slope;      ///< its fault: deg C, deg C per cycle
+	int out;                ///< whether it should be left out
+};
+
+static const struct fuse_case fuse_cases[] = {
+	{ "step fault",   3, { 1, 1, 1 }, 2, 10.0f, 0,     1 },
+	{ "slow drift",   3, { 1, 1, 1 }, 1, 0,     0.05f, 1 },
+	{ "weighted pair", 2, { 1, 2, 0 }, 0, 3.0f,  0,     1 },
+	{ "equal pair",   2, { 1, 1, 0 }, 1, 3.0f,  0,     0 },
+};
+
+// +-0.05 deg C of sensor noise
+static float check_noise(uint32_t *seed)
+{
+	*seed = *seed * 1103515245u + 12345u;
+	return ((*seed >> 8) / 16777216.0f - 0.5f) * 0.1f;
+}
+
+static int check_case(FILE *f, const struct fuse_case *k)
+{
+	struct fusion fu = { .n = k->n, .tol = 1.0f };
+	uint32_t seed = 1;
+	float temp = 0, sd;
+	int c, i, used, was_out = 0;
+
+	for (i = 0; i < k->n; i++)
+		fu.m[i].weight = k->weight[i];
+	for (c = 0; c < CHECK_CYCLES; c++) {
+		for (i = 0; i < k->n; i++) {
+			fu.m[i].temp = CHECK_TEMP + check_noise(&seed);
+			if (i == k->bad && c >= CHECK_FAULT_AT)
+				fu.m[i].temp += k->step + k->slope * (c - CHECK_FAULT_AT);
+			fu.m[i].have = 1;
+		}
+		used = fuse_cycle(&fu, &temp, &sd);
+		for (i = 0; i < k->n; i++)
+			if (fu.m[i].drift && (i != k->bad || !k->out)) {
+				fprintf(f, "%-14s FAILED: sensor %d left out at cycle %d\n",
+					k->name, i, c);
+				return 1;
+			}
+		if (was_out && !fu.m[k->bad].drift) {
+			fprintf(f, "%-14s FAILED: sensor %d back in at cycle %d\n",
+				k->name, k->bad, c);
+			return 1;
+		}
+		was_out = fu.m[k->bad].drift;
+		if (used < k->n - 1) {
+			fprintf(f, "%-14s FAILED: %d sensors used at cycle %d\n",
+				k->name, used, c);
+			return 1;
+		}
+		// a pair of the same weight has no majority to hold on to
+		if (k->out && fabsf(temp - CHECK_TEMP) > 0.2f) {
+			fprintf(f, "%-14s FAILED: fused %.2f deg C at cycle %d\n",
+				k->name, temp, c);
+			return 1;
+		}
+	}
+	if (k->out && !was_out) {
+		fprintf(f, "%-14s FAILED: sensor %d never left out\n", k->name, k->bad);
+		return 1;
+	}
+	if (!k->out && !fu.disagree) {
+		fprintf(f, "%-14s FAILED: no disagreement\n", k->name);
+		return 1;
+	}
+	fprintf(f, "%-14s ok\n", k->name);
+	return 0;
+}
+
+int fuse_check(FILE *f)
+{
+	size_t i;
+	int failed = 0;
+
+	for (i = 0; i < sizeof(fuse_cases) / sizeof(fuse_cases[0]); i++)
+		failed += check_case(f, &fuse_cases[i]);
+	return failed;
+}
@@ -0,0 +1,48 @@
+/* ---------------------------------------------------------------------
+ *                           fuse.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Fusion of redundant temperature sensors: weighted median,
+ *              calibration offsets, and a drifting sensor left out
+ * --------------------------------------------------------------------*/
+
+#ifndef FUSE_H
+#define FUSE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define FUSE_MAX            8       ///< sensors in a fusion
+
+struct fuse_member {
+	float offset;           ///< deg C, added to its readings (calibration)
+	float weight;           ///< > 0
+	uint8_t drift;          ///< left out: off the others by more than tol
+	uint8_t changed;        ///< drift changed in the last fuse_cycle()
+	uint8_t have;           ///< temp is a reading of this cycle
+	float temp;             ///< calibrated
+	float dev;              ///< smoothed distance from the median, deg C
+};
+
+struct fusion {
+	int n;
+	float tol;              ///< deg C a sensor may be off the others
+	uint8_t disagree;       ///< the sensors left in span more than tol
+	uint8_t hold;           ///< cycles until another one may go out
+	struct fuse_member m[FUSE_MAX];
+};
+
+float fuse_wmedian(float *v, float *w, int n);  ///< sorts v and w
+
+// Combines the readings of a cycle (m[].have, m[].temp) into *temp and
+// their RMS deviation from it into *sd, and moves sensors in and out of
+// the fusion. Returns the number of sensors used, 0 if none had a reading.
+int fuse_cycle(struct fusion *f, float *temp, float *sd);
+
+// step fault and slow drift scenarios; returns how many failed
+int fuse_check(FILE *f);
+
+#endif /* FUSE_H */
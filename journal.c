@@ -0,0 +1,376 @@
+/* ---------------------------------------------------------------------
+ *                           journal.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Crash-safe append-only log of readings. After an 8 byte
+ *              header the file is a sequence of frames
+ *
+ *                magic (2) | len (2) | crc32c (4) | payload (len)
+ *
+ *              appended with write(2) and made durable by group commit
+ *              (fdatasync per N records or T ms). A power cut can only
+ *              leave a torn or zero-filled tail behind the last durable
+ *              frame; opening the journal checks every frame and
+ *              truncates the file after the last intact one. One
+ *              process writes a journal at a time (flock).
+ * --------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "arena.h"
+#include "journal.h"
+#include "latency.h"
+
+#define JOURNAL_HDR         8
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_init(void)
+{
+	uint32_t i, k, c;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (k = 0; k < 8; k++)
+			c = c & 1 ? (c >> 1) ^ 0x82f63b78u : c >> 1;
+		crc_table[i] = c;
+	}
+}
+
+// CRC-32C (Castagnoli), the one iSCSI and ext4 use; pass 0 to start
+uint32_t crc32c(uint32_t crc, const void *data, size_t n)
+{
+	const unsigned char *p = data;
+
+	// the compaction thread checks frames too
+	pthread_once(&crc_once, crc32c_init);
+	crc = ~crc;
+	while (n--)
+		crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static uint32_t frame_crc(const struct journal_frame *fr, const void *payload)
+{
+	return crc32c(crc32c(0, &fr->len, sizeof(fr->len)), payload, fr->len);
+}
+
+// buffered reads for journal_scan(), no stdio: it runs on the
+// compaction thread too, which must not allocate
+struct jreader {
+	int fd;
+	size_t pos, len;
+	unsigned char buf[JOURNAL_BUF];
+};
+
+// n bytes into dst (NULL: only into the crc), 0 if the file ends first
+static int jr_read(struct jreader *r, void *dst, size_t n, uint32_t *crc)
+{
+	unsigned char *d = dst;
+
+	while (n) {
+		size_t k;
+
+		if (r->pos == r->len) {
+			ssize_t got = read(r->fd, r->buf, sizeof(r->buf));
+
+			if (got < 0 && errno == EINTR)
+				continue;
+			if (got <= 0)
+				return 0;
+			r->pos = 0;
+			r->len = got;
+		}
+		k = r->len - r->pos < n ? r->len - r->pos : n;
+		if (crc)
+			*crc = crc32c(*crc, r->buf + r->pos, k);
+		if (d) {
+			memcpy(d, r->buf + r->pos, k);
+			d += k;
+		}
+		r->pos += k;
+		n -= k;
+	}
+	return 1;
+}
+
+long journal_scan(const char *path, uint64_t *good, uint64_t *size,
+		  void (*fn)(const struct jrec *r, void *arg), void *arg)
+{
+	struct jreader r = { .fd = -1 };
+	struct journal_frame fr;
+	char hdr[JOURNAL_HDR];
+	struct stat st;
+	long records = 0;
+	size_t n;
+
+	*good = *size = 0;
+	r.fd = open(path, O_RDONLY);
+	if (r.fd < 0)
+		return -1;
+	if (fstat(r.fd, &st) == 0)
+		*size = st.st_size;
+	n = *size < JOURNAL_HDR ? *size : JOURNAL_HDR;
+	if (!jr_read(&r, hdr, n, NULL) || memcmp(hdr, JOURNAL_MAGIC, n)) {
+		close(r.fd);
+		return -2;
+	}
+	if (n < JOURNAL_HDR) {
+		// nothing, or a torn header
+		close(r.fd);
+		return 0;
+	}
+	*good = JOURNAL_HDR;
+	while (jr_read(&r, &fr, sizeof(fr), NULL)) {
+		struct jrec rec;
+		uint32_t crc = crc32c(0, &fr.len, sizeof(fr.len));
+
+		if (fr.magic != JOURNAL_FRAME_MAGIC)
+			break;
+		// other payload sizes: record kinds of a later version
+		if (fr.len == sizeof(rec)) {
+			if (!jr_read(&r, &rec, sizeof(rec), &crc) || crc != fr.crc)
+				break;
+			if (fn)
+				fn(&rec, arg);
+		} else if (!jr_read(&r, NULL, fr.len, &crc) || crc != fr.crc) {
+			break;
+		}
+		*good += sizeof(fr) + fr.len;
+		records++;
+	}
+	close(r.fd);
+	return records;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	while (len) {
+		ssize_t n = write(fd, p, len);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int journal_open(struct journal *j, const char *path, uint32_t sync_n, uint32_t sync_ms)
+{
+	unsigned char *buf = j->buf;
+	uint64_t good, size;
+	long n;
+
+	// the buffer outlives a close, for the next journal in j
+	memset(j, 0, sizeof(*j));
+	j->path = path;
+	j->sync_n = sync_n;
+	j->sync_ms = sync_ms;
+	j->buf = buf ? buf : arena_alloc(JOURNAL_BUF);
+	j->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (!j->buf || j->fd < 0) {
+		fprintf(stderr, "Error: Could not open journal `%s': %s\n",
+			path, j->buf ? strerror(errno) : "out of memory");
+		if (j->fd >= 0)
+			close(j->fd);
+		return -1;
+	}
+	// the unsynced tail of another writer looks torn; it is not ours
+	// to cut
+	if (flock(j->fd, LOCK_EX | LOCK_NB) < 0) {
+		if (errno == EWOULDBLOCK)
+			fprintf(stderr, "Error: Journal `%s' is in use by another process\n", path);
+		else
+			fprintf(stderr, "Error: Could not lock journal `%s': %s\n",
+				path, strerror(errno));
+		close(j->fd);
+		return -1;
+	}
+
+	n = journal_scan(path, &good, &size, NULL, NULL);
+	if (n == -2) {
+		fprintf(stderr, "Error: `%s' is not a journal\n", path);
+		close(j->fd);
+		return -1;
+	}
+	if (n < 0) {
+		fprintf(stderr, "Error: Could not read journal `%s': %s\n",
+			path, strerror(errno));
+		close(j->fd);
+		return -1;
+	}
+	// cut the torn tail, for good, before anything new goes behind it
+	if (good < size) {
+		if (ftruncate(j->fd, good) < 0 || fdatasync(j->fd) < 0) {
+			fprintf(stderr, "Error: Could not truncate journal `%s': %s\n",
+				path, strerror(errno));
+			close(j->fd);
+			return -1;
+		}
+		fprintf(stderr, "Journal `%s': %ld records, torn tail of %llu bytes cut\n",
+			path, n, (unsigned long long)(size - good));
+	}
+	if (good == 0 && (write_all(j->fd, JOURNAL_MAGIC, JOURNAL_HDR) < 0 ||
+			  fdatasync(j->fd) < 0)) {
+		fprintf(stderr, "Error: Could not write journal `%s': %s\n",
+			path, strerror(errno));
+		close(j->fd);
+		return -1;
+	}
+	j->size = good ? good : JOURNAL_HDR;
+	lseek(j->fd, j->size, SEEK_SET);
+	return 0;
+}
+
+static int journal_write(struct journal *j)
+{
+	if (j->len == 0)
+		return 0;
+	if (write_all(j->fd, j->buf, j->len) < 0) {
+		fprintf(stderr, "Error: Could not write journal `%s': %s\n",
+			j->path, strerror(errno));
+		j->len = 0;
+		// no torn frame in the middle: recovery would cut everything
+		// appended behind it
+		if (ftruncate(j->fd, j->size) < 0 ||
+		    lseek(j->fd, j->size, SEEK_SET) < 0)
+			fprintf(stderr, "Error: Could not truncate journal `%s': %s\n",
+				j->path, strerror(errno));
+		return -1;
+	}
+	j->size += j->len;
+	j->len = 0;
+	return 0;
+}
+
+void journal_append(struct journal *j, const struct jrec *r)
+{
+	struct journal_frame fr = { JOURNAL_FRAME_MAGIC, sizeof(*r), 0 };
+
+	if (j->len + sizeof(fr) + sizeof(*r) > JOURNAL_BUF)
+		journal_write(j);
+	fr.crc = frame_crc(&fr, r);
+	memcpy(j->buf + j->len, &fr, sizeof(fr));
+	memcpy(j->buf + j->len + sizeof(fr), r, sizeof(*r));
+	j->len += sizeof(fr) + sizeof(*r);
+	j->unsynced++;
+	j->records++;
+}
+
+static int journal_sync(struct journal *j)
+{
+	j->unsynced = 0;
+	j->first_unsynced = 0;
+	j->syncs++;
+	if (fdatasync(j->fd) < 0) {
+		fprintf(stderr, "Error: Could not sync journal `%s': %s\n",
+			j->path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+// hands the appended records to the kernel, and syncs if it is time
+int journal_commit(struct journal *j, uint64_t now)
+{
+	int res = journal_write(j);
+
+	if (!j->unsynced || !j->sync_n)
+		return res;
+	if (!j->first_unsynced)
+		j->first_unsynced = now;
+	if (j->unsynced >= j->sync_n ||
+	    (j->sync_ms && now - j->first_unsynced >= j->sync_ms * 1000000ull))
+		res |= journal_sync(j);
+	return res;
+}
+
+uint64_t journal_sync_due(const struct journal *j)
+{
+	if (!j->unsynced || !j->sync_n || !j->sync_ms || !j->first_unsynced)
+		return 0;
+	return j->first_unsynced + j->sync_ms * 1000000ull;
+}
+
+void journal_close(struct journal *j)
+{
+	if (j->fd < 0)
+		return;
+	journal_write(j);
+	if (j->unsynced && j->sync_n)
+		journal_sync(j);
+	close(j->fd);
+	j->fd = -1;
+}
+
+long journal_read(const char *path, void (*fn)(const struct jrec *r, void *arg), void *arg)
+{
+	uint64_t good, size;
+	long n = journal_scan(path, &good, &size, fn, arg);
+
+	if (n == -2)
+		fprintf(stderr, "Error: `%s' is not a journal\n", path);
+	else if (n < 0)
+		fprintf(stderr, "Error: Could not read journal `%s': %s\n",
+			path, strerror(errno));
+	else if (good < size)
+		fprintf(stderr, "Journal `%s': torn tail of %llu bytes after %ld records\n",
+			path, (unsigned long long)(size - good), n);
+	return n < 0 ? -1 : n;
+}
+
+// Appends n readings, one commit per reading as in continuous mode,
+// under a few sync policies, into a scratch journal in dir
+void journal_bench(FILE *f, size_t n, const char *dir)
+{
+	static const struct { uint32_t n, ms; const char *name; } pol[] = {
+		{ 1, 0, "sync every record" },
+		{ 16, 1000, "sync per 16 / 1 s" },
+		{ 256, 1000, "sync per 256 / 1 s" },
+		{ 0, 0, "never sync" },
+	};
+	char path[4096];
+	struct jrec r = { .addr = 0x44, .type = 3, .status = 3 };
+	struct journal j = { .buf = NULL };
+	unsigned p;
+
+	snprintf(path, sizeof(path), "%s/room_temp-bench.jrnl", dir);
+	for (p = 0; p < sizeof(pol) / sizeof(pol[0]); p++) {
+		uint64_t t0, dt;
+		size_t i;
+
+		unlink(path);
+		if (journal_open(&j, path, pol[p].n, pol[p].ms) < 0)
+			return;
+		t0 = lat_now();
+		for (i = 0; i < n; i++) {
+			r.ts = t0 + i;
+			r.temp = 20.0f + (i % 100) * 0.01f;
+			r.humi = 50.0f;
+			journal_append(&j, &r);
+			journal_commit(&j, lat_now());
+		}
+		journal_close(&j);
+		dt = lat_now() - t0;
+		fprintf(f, "%-20s %10.0f records/s, %6llu fsyncs, %.1f us/record\n",
+			pol[p].name, n * 1e9 / dt, (unsigned long long)j.syncs,
+			dt / 1e3 / n);
+	}
+	unlink(path);
+}
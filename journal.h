@@ -0,0 +1,80 @@
+/* ---------------------------------------------------------------------
+ *                           journal.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Crash-safe append-only log of readings: framed,
+ *              checksummed records with group-commit fsync
+ * --------------------------------------------------------------------*/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define JOURNAL_MAGIC       "RTJRNL1\n"     ///< file header, 8 bytes
+#define JOURNAL_FRAME_MAGIC 0x4a52          ///< "RJ"
+#define JOURNAL_BUF         65536           ///< write buffer, struct journal
+
+// Frame header, in host byte order like the raw log; the CRC-32C
+// covers len and the payload, so a torn or zero-filled tail is caught
+struct journal_frame {
+	uint16_t magic;
+	uint16_t len;           ///< payload bytes
+	uint32_t crc;
+};
+
+// one reading, as output (after filters, before the deadband)
+struct jrec {
+	uint64_t ts;            ///< CLOCK_REALTIME, ns
+	uint32_t id;            ///< sensor index
+	uint8_t addr;
+	uint8_t type;           ///< enum sensor_type
+	int8_t status;          ///< valid quantities, -1: failed reading
+	uint8_t flags;          ///< of struct sample (0 in older journals)
+	float temp;
+	float humi;
+};
+
+// Group commit: the records go to the kernel at every journal_commit(),
+// and to the disk (fdatasync) once sync_n records or sync_ms ms have
+// gathered since the last sync, whichever comes first. sync_n 1 syncs
+// every record, 0 never (the page cache decides); sync_ms 0 puts
+// no time limit on it.
+struct journal {
+	int fd;
+	const char *path;
+	unsigned char *buf;     ///< frames not written yet
+	size_t len;
+	uint32_t sync_n;
+	uint32_t sync_ms;
+	uint32_t unsynced;      ///< records written since the last sync
+	uint64_t first_unsynced;    ///< monotonic ns, of the oldest of them
+	uint64_t size;          ///< file size, after recovery
+	uint64_t records, syncs;
+};
+
+// j->buf is kept if set (a journal reopened), else taken from the arena
+int journal_open(struct journal *j, const char *path, uint32_t sync_n, uint32_t sync_ms);
+void journal_append(struct journal *j, const struct jrec *r);
+int journal_commit(struct journal *j, uint64_t now);
+uint64_t journal_sync_due(const struct journal *j);     ///< monotonic ns, 0: nothing to sync
+void journal_close(struct journal *j);
+
+// Calls fn for every intact record, stops at a torn tail. good: the
+// end of the last intact frame, size: of the file. Returns the records,
+// -1 if the file cannot be read (errno), -2 if it is not a journal.
+// Quiet, and safe on a journal being written.
+long journal_scan(const char *path, uint64_t *good, uint64_t *size,
+		  void (*fn)(const struct jrec *r, void *arg), void *arg);
+// journal_scan(), reporting errors and a torn tail
+long journal_read(const char *path, void (*fn)(const struct jrec *r, void *arg), void *arg);
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t n);
+void journal_bench(FILE *f, size_t n, const char *dir);
+
+#endif /* JOURNAL_H */
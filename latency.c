@@ -0,0 +1,167 @@
+/* ---------------------------------------------------------------------
+ *                           latency.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Monotonic timestamps and fixed-bucket log-linear
+ *              latency histograms, kept per sensor and per phase.
+ *              Histograms are dumped on request (--stats) or when
+ *              SIGUSR1 is received.
+ * --------------------------------------------------------------------*/
+
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+#include "latency.h"
+
+static const char *phase_names[LAT_PHASES] = {
+	"xfer", "poll", "sleep", "wait", "sample"
+};
+
+static struct lat_sensor *lat_sensors;
+static volatile sig_atomic_t lat_dump_req;
+
+uint64_t lat_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static unsigned lat_bucket(uint32_t us)
+{
+	unsigned msb, shift, idx;
+
+	if (us < LAT_SUB_BUCKETS)
+		return us;
+	msb = 31 - __builtin_clz(us);
+	shift = msb - LAT_SUB_BITS;
+	idx = (shift + 1) * LAT_SUB_BUCKETS + ((us >> shift) - LAT_SUB_BUCKETS);
+	return idx < LAT_BUCKETS ? idx : LAT_BUCKETS - 1;
+}
+
+// lowest value (us) that falls into bucket idx
+static uint32_t lat_bucket_low(unsigned idx)
+{
+	unsigned shift;
+
+	if (idx < LAT_SUB_BUCKETS)
+		return idx;
+	shift = idx / LAT_SUB_BUCKETS - 1;
+	return (uint32_t)(LAT_SUB_BUCKETS + idx % LAT_SUB_BUCKETS) << shift;
+}
+
+void lat_record(struct lat_hist *h, uint64_t ns)
+{
+	uint64_t us64 = ns / 1000;
+	uint32_t us = us64 > UINT32_MAX ? UINT32_MAX : (uint32_t)us64;
+
+	if (h->count == 0 || us < h->min_us)
+		h->min_us = us;
+	if (us > h->max_us)
+		h->max_us = us;
+	h->count++;
+	h->sum_us += us;
+	h->bucket[lat_bucket(us)]++;
+}
+
+// upper bound of the bucket holding the given percentile, clamped to max
+uint32_t lat_percentile(const struct lat_hist *h, double pct)
+{
+	uint64_t rank, seen = 0;
+	unsigned i;
+
+	if (h->count == 0)
+		return 0;
+	rank = (uint64_t)(pct / 100.0 * h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen >= rank) {
+			uint32_t hi = i + 1 < LAT_BUCKETS ? lat_bucket_low(i + 1) - 1 : h->max_us;
+			return hi < h->max_us ? hi : h->max_us;
+		}
+	}
+	return h->max_us;
+}
+
+void lat_register(struct lat_sensor *s, const char *name, int addr)
+{
+	memset(s, 0, sizeof(*s));
+	s->name = name;
+	s->addr = addr;
+	s->next = lat_sensors;
+	lat_sensors = s;
+}
+
+const struct lat_sensor *lat_first(void)
+{
+	return lat_sensors;
+}
+
+void lat_dump(FILE *f, const struct lat_sensor *s)
+{
+	int p;
+	unsigned i;
+
+	fprintf(f, "Latency histograms for %s @0x%02x (us)\n", s->name, s->addr);
+	for (p = 0; p < LAT_PHASES; p++) {
+		const struct lat_hist *h = &s->phase[p];
+
+		if (h->count == 0)
+			continue;
+		fprintf(f, "  %-6s n=%u min=%u p50=%u p90=%u p99=%u max=%u mean=%.1f\n",
+			phase_names[p], h->count, h->min_us,
+			lat_percentile(h, 50), lat_percentile(h, 90),
+			lat_percentile(h, 99), h->max_us,
+			(double)h->sum_us / h->count);
+		for (i = 0; i < LAT_BUCKETS; i++) {
+			if (h->bucket[i] == 0)
+				continue;
+			fprintf(f, "         [%8u,%8u) %u\n", lat_bucket_low(i),
+				i + 1 < LAT_BUCKETS ? lat_bucket_low(i + 1) : UINT32_MAX,
+				h->bucket[i]);
+		}
+	}
+}
+
+void lat_dump_all(FILE *f)
+{
+	const struct lat_sensor *s;
+
+	for (s = lat_sensors; s; s = s->next)
+		lat_dump(f, s);
+	fflush(f);
+}
+
+static void lat_sigusr1(int sig)
+{
+	(void)sig;
+	lat_dump_req = 1;
+}
+
+void lat_install_signal(void)
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = lat_sigusr1;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, NULL);
+}
+
+// stdio is not async-signal-safe, so the handler only raises a flag
+// and the dump is done from here, at the next sample/poll boundary
+void lat_poll_signal(void)
+{
+	if (lat_dump_req) {
+		lat_dump_req = 0;
+		lat_dump_all(stderr);
+	}
+}
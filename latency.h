@@ -0,0 +1,62 @@
+/* ---------------------------------------------------------------------
+ *                           latency.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Monotonic timestamps and fixed-bucket log-linear
+ *              latency histograms, kept per sensor and per phase
+ * --------------------------------------------------------------------*/
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Histogram layout (values in microseconds): the first LAT_SUB_BUCKETS
+// buckets are 1us wide, then every power of two is split into
+// LAT_SUB_BUCKETS linear buckets. Max relative bucket error is 1/8.
+#define LAT_SUB_BITS        3
+#define LAT_SUB_BUCKETS     (1 << LAT_SUB_BITS)
+#define LAT_MAGNITUDES      23      ///< covers up to ~33 s
+#define LAT_BUCKETS         (LAT_SUB_BUCKETS * (LAT_MAGNITUDES + 1))
+
+enum lat_phase {
+	LAT_XFER = 0,   ///< one SMBus transaction (driver + clock stretching)
+	LAT_POLL,       ///< one status poll inside busy_wait_limited()
+	LAT_SLEEP,      ///< one sleep (busy wait loop or fixed conversion wait)
+	LAT_WAIT,       ///< whole busy_wait_limited() call (wait policy)
+	LAT_SAMPLE,     ///< whole readsensorfn() call
+	LAT_PHASES
+};
+
+struct lat_hist {
+	uint32_t count;
+	uint64_t sum_us;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t bucket[LAT_BUCKETS];
+};
+
+struct lat_sensor {
+	const char *name;
+	int addr;
+	struct lat_hist phase[LAT_PHASES];
+	struct lat_sensor *next;
+};
+
+uint64_t lat_now(void);
+void lat_record(struct lat_hist *h, uint64_t ns);
+uint32_t lat_percentile(const struct lat_hist *h, double pct);
+
+void lat_register(struct lat_sensor *s, const char *name, int addr);
+const struct lat_sensor *lat_first(void);
+void lat_dump(FILE *f, const struct lat_sensor *s);
+void lat_dump_all(FILE *f);
+
+void lat_install_signal(void);
+void lat_poll_signal(void);
+
+#endif /* LATENCY_H */
@@ -0,0 +1,675 @@
+/* ---------------------------------------------------------------------
+ *                           output.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Sample records and their output formats:
+ *              human ("Temp=..", "Humi=..") and bare (-b/-r numbers),
+ *              or one line per sample as JSON, CSV or InfluxDB line
+ *              protocol (--format); with --derived, followed by dew
+ *              point, absolute humidity, humidex, heat index and VPD.
+ *              Records are rendered into one static buffer, numbers
+ *              with integer arithmetic, and the buffer goes out with
+ *              one write(2) per out_flush() (or when it fills up).
+ *              With an output queue (outq.c) the records are rendered
+ *              and written by its writer thread instead.
+ * --------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "latency.h"
+#include "output.h"
+#include "outq.h"
+
+#define OUT_BUF_SIZE        65536
+#define OUT_REC_MAX         384     ///< longest record rendered at once
+
+static uint8_t out_bare;
+static const char *out_deg = "'C";
+static enum out_format out_fmt;
+static uint8_t out_header;          ///< CSV header written
+static uint8_t out_derived;         ///< CSV: with the derived columns
+
+static int out_fd = 1;
+static char out_buf[OUT_BUF_SIZE];
+static size_t out_len;
+
+static const char *const out_formats[] = {
+	[OUT_TEXT]   = "text",
+	[OUT_JSON]   = "json",
+	[OUT_CSV]    = "csv",
+	[OUT_INFLUX] = "influx",
+};
+
+int out_format_parse(const char *name)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(out_formats) / sizeof(out_formats[0]); i++)
+		if (!strcmp(name, out_formats[i]))
+			return i;
+	return -1;
+}
+
+void out_init(uint8_t bare_fmt, const char *deg, enum out_format fmt,
+	      uint8_t derived)
+{
+	out_bare = fmt == OUT_TEXT ? bare_fmt : 0;
+	out_fmt = fmt;
+	out_derived = derived;
+	if (deg)
+		out_deg = deg;
+}
+
+// which quantities to print in bare format: if the sensor has only
+// one of the asked for quantities, print that one
+static uint8_t bare_mask(int8_t caps)
+{
+	if (caps < 3 && out_bare > 0)
+		return caps;
+	return out_bare;
+}
+
+uint8_t deadband_mask(const struct deadband *db, struct deadband_state *st,
+		      const struct sample *s)
+{
+	const float v[2] = { s->temp, s->humi };
+	uint8_t mask = 0;
+	int i;
+
+	if (!db->on || s->status <= 0)
+		return s->mask;
+
+	for (i = 0; i < 2; i++) {
+		uint8_t bit = 1 << i;
+
+		if (!(s->mask & bit))
+			continue;
+		if (!(st->have & bit) || fabsf(v[i] - st->last[i]) > db->delta[i] ||
+		    (db->heartbeat && s->ts - st->last_ts[i] >= db->heartbeat)) {
+			st->have |= bit;
+			st->last[i] = v[i];
+			st->last_ts[i] = s->ts;
+			mask |= bit;
+		}
+	}
+	return mask;
+}
+
+// room for a record of up to n bytes at out_buf + out_len
+static char *out_reserve(size_t n)
+{
+	if (out_len + n > sizeof(out_buf))
+		out_write();
+	return out_buf + out_len;
+}
+
+static char *fmt_str(char *p, const char *str)
+{
+	while (*str)
+		*p++ = *str++;
+	return p;
+}
+
+static char *fmt_uint(char *p, uint64_t v)
+{
+	char tmp[20];
+	int n = 0;
+
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	while (n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+// v with prec (0..3) decimals, the same digits as printf("%.*f").
+// A float times 10^prec is exact in a double (24 + 10 bits), so rint()
+// rounds the exact value, ties to even, like printf does.
+static char *fmt_fixed(char *p, float v, int prec)
+{
+	static const double scale[] = { 1, 10, 100, 1000 };
+	char tmp[24];
+	double r;
+	uint64_t u;
+	int n = 0;
+
+	if (!isfinite(v) || fabsf(v) >= 1e15f)
+		return p + sprintf(p, "%.*f", prec, v);
+	r = rint((double)v * scale[prec]);
+	if (signbit(r))
+		*p++ = '-';
+	u = (uint64_t)fabs(r);
+	do {
+		tmp[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u || n <= prec);
+	while (n > prec)
+		*p++ = tmp[--n];
+	if (prec) {
+		*p++ = '.';
+		while (n)
+			*p++ = tmp[--n];
+	}
+	return p;
+}
+
+static char *fmt_addr(char *p, uint8_t addr)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	*p++ = '0';
+	*p++ = 'x';
+	*p++ = hex[addr >> 4];
+	*p++ = hex[addr & 15];
+	return p;
+}
+
+// ok, or drift/disagree from the fusion; error for a failed reading
+static const char *status_name(const struct sample *s)
+{
+	if (s->status <= 0)
+		return "error";
+	if (s->flags & SAMPLE_DRIFT)
+		return "drift";
+	if (s->flags & SAMPLE_DISAGREE)
+		return "disagree";
+	return "ok";
+}
+
+// {"ts":NS,"id":N,"sensor":"SHT30","addr":"0x44","temp":T,"humi":H,"status":"ok"}
+static char *fmt_json(char *p, const struct sample *s, uint8_t mask)
+{
+	p = fmt_str(p, "{\"ts\":");
+	p = fmt_uint(p, s->ts);
+	p = fmt_str(p, ",\"id\":");
+	p = fmt_uint(p, s->id);
+	p = fmt_str(p, ",\"sensor\":\"");
+	p = fmt_str(p, s->sensor);
+	p = fmt_str(p, "\",\"addr\":\"");
+	p = fmt_addr(p, s->addr);
+	*p++ = '"';
+	if (mask & 0x01) {
+		p = fmt_str(p, ",\"temp\":");
+		p = fmt_fixed(p, s->temp, 2);
+	}
+	if (mask & 0x02) {
+		p = fmt_str(p, ",\"humi\":");
+		p = fmt_fixed(p, s->humi, 1);
+	}
+	if (mask && s->derived) {
+		p = fmt_str(p, ",\"dew\":");
+		p = fmt_fixed(p, s->dp.dew, 2);
+		p = fmt_str(p, ",\"ah\":");
+		p = fmt_fixed(p, s->dp.ah, 2);
+		p = fmt_str(p, ",\"humidex\":");
+		p = fmt_fixed(p, s->dp.humidex, 1);
+		p = fmt_str(p, ",\"heat_index\":");
+		p = fmt_fixed(p, s->dp.heat_index, 1);
+		p = fmt_str(p, ",\"vpd\":");
+		p = fmt_fixed(p, s->dp.vpd, 3);
+	}
+	p = fmt_str(p, ",\"status\":\"");
+	p = fmt_str(p, status_name(s));
+	p = fmt_str(p, "\"}\n");
+	return p;
+}
+
+// ts,id,sensor,addr,temp,humi,status[,dew,ah,humidex,heat_index,vpd];
+// empty fields for what is not there
+static char *fmt_csv(char *p, const struct sample *s, uint8_t mask)
+{
+	if (!out_header) {
+		p = fmt_str(p, out_derived ?
+			    "ts,id,sensor,addr,temp,humi,status,dew,ah,humidex,heat_index,vpd\n" :
+			    "ts,id,sensor,addr,temp,humi,status\n");
+		out_header = 1;
+	}
+	p = fmt_uint(p, s->ts);
+	*p++ = ',';
+	p = fmt_uint(p, s->id);
+	*p++ = ',';
+	p = fmt_str(p, s->sensor);
+	*p++ = ',';
+	p = fmt_addr(p, s->addr);
+	*p++ = ',';
+	if (mask & 0x01)
+		p = fmt_fixed(p, s->temp, 2);
+	*p++ = ',';
+	if (mask & 0x02)
+		p = fmt_fixed(p, s->humi, 1);
+	*p++ = ',';
+	p = fmt_str(p, status_name(s));
+	if (out_derived) {
+		if (mask && s->derived) {
+			*p++ = ',';
+			p = fmt_fixed(p, s->dp.dew, 2);
+			*p++ = ',';
+			p = fmt_fixed(p, s->dp.ah, 2);
+			*p++ = ',';
+			p = fmt_fixed(p, s->dp.humidex, 1);
+			*p++ = ',';
+			p = fmt_fixed(p, s->dp.heat_index, 1);
+			*p++ = ',';
+			p = fmt_fixed(p, s->dp.vpd, 3);
+		} else {
+			p = fmt_str(p, ",,,,,");
+		}
+	}
+	*p++ = '\n';
+	return p;
+}
+
+// a line protocol tag value: spaces, commas and = escaped
+static char *fmt_tag(char *p, const char *str)
+{
+	for (; *str; str++) {
+		if (*str == ' ' || *str == ',' || *str == '=')
+			*p++ = '\\';
+		*p++ = *str;
+	}
+	return p;
+}
+
+// room_temp,sensor=SHT30,addr=0x44,id=N temp=T,humi=H,status="ok" NS
+static char *fmt_influx(char *p, const struct sample *s, uint8_t mask)
+{
+	p = fmt_str(p, "room_temp,sensor=");
+	p = fmt_tag(p, s->sensor);
+	p = fmt_str(p, ",addr=");
+	p = fmt_addr(p, s->addr);
+	p = fmt_str(p, ",id=");
+	p = fmt_uint(p, s->id);
+	*p++ = ' ';
+	if (mask & 0x01) {
+		p = fmt_str(p, "temp=");
+		p = fmt_fixed(p, s->temp, 2);
+		*p++ = ',';
+	}
+	if (mask & 0x02) {
+		p = fmt_str(p, "humi=");
+		p = fmt_fixed(p, s->humi, 1);
+		*p++ = ',';
+	}
+	if (mask && s->derived) {
+		p = fmt_str(p, "dew=");
+		p = fmt_fixed(p, s->dp.dew, 2);
+		p = fmt_str(p, ",ah=");
+		p = fmt_fixed(p, s->dp.ah, 2);
+		p = fmt_str(p, ",humidex=");
+		p = fmt_fixed(p, s->dp.humidex, 1);
+		p = fmt_str(p, ",heat_index=");
+		p = fmt_fixed(p, s->dp.heat_index, 1);
+		p = fmt_str(p, ",vpd=");
+		p = fmt_fixed(p, s->dp.vpd, 3);
+		*p++ = ',';
+	}
+	p = fmt_str(p, "status=\"");
+	p = fmt_str(p, status_name(s));
+	p = fmt_str(p, "\" ");
+	p = fmt_uint(p, s->ts);
+	*p++ = '\n';
+	return p;
+}
+
+static void render_sample(const struct sample *s)
+{
+	uint8_t bare, mask = s->mask;
+	char *p, *p0;
+
+	// the structured formats report failed readings too
+	if (out_fmt != OUT_TEXT && (s->status <= 0 || mask)) {
+		p = p0 = out_reserve(OUT_REC_MAX);
+		mask = s->status > 0 ? mask : 0;
+		if (out_fmt == OUT_JSON)
+			p = fmt_json(p, s, mask);
+		else if (out_fmt == OUT_CSV)
+			p = fmt_csv(p, s, mask);
+		else
+			p = fmt_influx(p, s, mask);
+		out_len += p - p0;
+		return;
+	}
+	bare = bare_mask(s->status);
+	if (s->status <= 0 || (mask == 0 && bare == 0))
+		return;
+
+	// in bare format a value held back by the deadband is marked, so
+	// it does not pass for a failed reading
+	p = p0 = out_reserve(OUT_REC_MAX);
+	if (bare & s->status & 0x01) {
+		if (mask & 0x01)
+			p = fmt_fixed(p, s->temp, 2);
+		else
+			*p++ = '=';
+		*p++ = '\n';
+	}
+	if (bare & s->status & 0x02) {
+		if (mask & 0x02)
+			p = fmt_fixed(p, s->humi, 1);
+		else
+			*p++ = '=';
+		*p++ = '\n';
+	}
+	if (bare == 0) {
+		if (mask & 0x01) {
+			p = fmt_str(p, "Temp=");
+			p = fmt_fixed(p, s->temp, 2);
+			p = fmt_str(p, out_deg);
+			*p++ = '\n';
+		}
+		if (mask & 0x02) {
+			p = fmt_str(p, "Humi=");
+			p = fmt_fixed(p, s->humi, 1);
+			p = fmt_str(p, "%\n");
+		}
+		if (s->derived) {
+			p = fmt_str(p, "DewPoint=");
+			p = fmt_fixed(p, s->dp.dew, 2);
+			p = fmt_str(p, out_deg);
+			p = fmt_str(p, "\nAbsHumi=");
+			p = fmt_fixed(p, s->dp.ah, 2);
+			p = fmt_str(p, "g/m3\nHumidex=");
+			p = fmt_fixed(p, s->dp.humidex, 1);
+			p = fmt_str(p, "\nHeatIndex=");
+			p = fmt_fixed(p, s->dp.heat_index, 1);
+			p = fmt_str(p, out_deg);
+			p = fmt_str(p, "\nVPD=");
+			p = fmt_fixed(p, s->dp.vpd, 3);
+			p = fmt_str(p, "kPa\n");
+		}
+		if (s->nconv > 1) {
+			if (mask & 0x01) {
+				p = fmt_str(p, "TempSD=");
+				p = fmt_fixed(p, s->temp_sd, 2);
+				p = fmt_str(p, out_deg);
+				*p++ = '\n';
+			}
+			if (mask & 0x02) {
+				p = fmt_str(p, "HumiSD=");
+				p = fmt_fixed(p, s->humi_sd, 1);
+				p = fmt_str(p, "%\n");
+			}
+			p = fmt_str(p, s->flags & SAMPLE_FUSED ? "Sensors=" : "Samples=");
+			p = fmt_uint(p, s->nok);
+			*p++ = '/';
+			p = fmt_uint(p, s->nconv);
+			*p++ = '\n';
+		}
+	}
+	out_len += p - p0;
+}
+
+void out_sample(const struct sample *s)
+{
+	struct out_rec r;
+
+	if (!outq_active) {
+		render_sample(s);
+		return;
+	}
+	r.kind = OUT_REC_SAMPLE;
+	r.nroll = 0;
+	r.u.s = *s;
+	outq_push(&r);
+}
+
+// the stdio rendering out_sample() replaced, kept as the reference
+// for out_bench()
+static void out_sample_stdio(FILE *f, const struct sample *s)
+{
+	uint8_t bare, mask = s->mask;
+
+	if (s->status <= 0 || mask == 0)
+		return;
+
+	bare = bare_mask(s->status);
+	if (bare & mask & 0x01)
+		fprintf(f, "%.2f\n", s->temp);
+	if (bare & mask & 0x02)
+		fprintf(f, "%.1f\n", s->humi);
+	if (bare == 0) {
+		if (mask & 0x01)
+			fprintf(f, "Temp=%.2f%s\n", s->temp, out_deg);
+		if (mask & 0x02)
+			fprintf(f, "Humi=%.1f%%\n", s->humi);
+		if (s->nconv > 1) {
+			if (mask & 0x01)
+				fprintf(f, "TempSD=%.2f%s\n", s->temp_sd, out_deg);
+			if (mask & 0x02)
+				fprintf(f, "HumiSD=%.1f%%\n", s->humi_sd);
+			fprintf(f, "Samples=%d/%d\n", s->nok, s->nconv);
+		}
+	}
+}
+
+// once per window, so snprintf is fine here
+static void out_qstats(const char *name, uint32_t period, const struct qsum *q,
+		       int prec, const char *unit)
+{
+	char *p = out_reserve(OUT_REC_MAX);
+	int n;
+
+	// bare: period mean sd min max p5 p50 p95 n
+	if (out_bare)
+		n = snprintf(p, OUT_REC_MAX, "%u %.*f %.*f %.*f %.*f %.*f %.*f %.*f %u\n",
+			     period, prec, q->mean, prec, q->sd,
+			     prec, q->min, prec, q->max, prec, q->p[0],
+			     prec, q->p[1], prec, q->p[2], q->n);
+	else
+		n = snprintf(p, OUT_REC_MAX, "%s[%us]: mean=%.*f%s sd=%.*f min=%.*f max=%.*f "
+			     "p5=%.*f p50=%.*f p95=%.*f n=%u\n", name, period,
+			     prec, q->mean, unit, prec, q->sd,
+			     prec, q->min, prec, q->max, prec, q->p[0],
+			     prec, q->p[1], prec, q->p[2], q->n);
+	if (n > 0)
+		out_len += n < OUT_REC_MAX ? n : OUT_REC_MAX - 1;
+}
+
+// window statistics as a JSON or line protocol record of their own
+static void out_qstats_rec(const struct window_rec *w, const char *name,
+			   const struct qsum *q, int prec)
+{
+	char *p = out_reserve(OUT_REC_MAX), *p0 = p, a[4];
+	uint64_t ts = w->start * 1000000000ULL;
+	int n;
+
+	fmt_addr(a, w->addr);
+	if (out_fmt == OUT_JSON) {
+		n = snprintf(p, OUT_REC_MAX, "{\"ts\":%" PRIu64 ",\"sensor\":\"%s\","
+			     "\"addr\":\"%.4s\",\"window\":%u,\"quantity\":\"%s\","
+			     "\"mean\":%.*f,\"sd\":%.*f,\"min\":%.*f,\"max\":%.*f,"
+			     "\"p5\":%.*f,\"p50\":%.*f,\"p95\":%.*f,\"n\":%u}\n",
+			     ts, w->sensor, a, w->period, name,
+			     prec, q->mean, prec, q->sd,
+			     prec, q->min, prec, q->max, prec, q->p[0],
+			     prec, q->p[1], prec, q->p[2], q->n);
+	} else {
+		p = fmt_str(p, "room_temp_window,sensor=");
+		p = fmt_tag(p, w->sensor);
+		n = snprintf(p, OUT_REC_MAX - (p - p0), ",addr=%.4s,"
+			     "window=%u,quantity=%s mean=%.*f,sd=%.*f,min=%.*f,max=%.*f,"
+			     "p5=%.*f,p50=%.*f,p95=%.*f,n=%ui %" PRIu64 "\n",
+			     a, w->period, name,
+			     prec, q->mean, prec, q->sd,
+			     prec, q->min, prec, q->max, prec, q->p[0],
+			     prec, q->p[1], prec, q->p[2], q->n, ts);
+		if (n >= 0)
+			n += p - p0;
+	}
+	if (n > 0)
+		out_len += n < OUT_REC_MAX ? n : OUT_REC_MAX - 1;
+}
+
+static void render_window(const struct window_rec *w)
+{
+	uint8_t bare = bare_mask(w->caps);
+
+	if (out_fmt != OUT_TEXT) {
+		if (w->caps & 0x01)
+			out_qstats_rec(w, "temp", &w->q[0], 2);
+		if (w->caps & 0x02)
+			out_qstats_rec(w, "humi", &w->q[1], 1);
+		return;
+	}
+	if (w->caps & 0x01 && (bare == 0 || bare & 0x01))
+		out_qstats("Temp", w->period, &w->q[0], 2, out_deg);
+	if (w->caps & 0x02 && (bare == 0 || bare & 0x02))
+		out_qstats("Humi", w->period, &w->q[1], 1, "%");
+}
+
+static void qsum(struct qsum *d, const struct qstats *q)
+{
+	int i;
+
+	d->mean = q->w.mean;
+	d->sd = welford_sd(&q->w);
+	d->min = q->w.min;
+	d->max = q->w.max;
+	for (i = 0; i < QSTATS_NQ; i++)
+		d->p[i] = p2_get(&q->q[i]);
+	d->n = q->w.n;
+}
+
+void out_window(const char *sensor, uint8_t addr, const struct window *w)
+{
+	struct out_rec r;
+
+	r.kind = OUT_REC_WINDOW;
+	r.nroll = 0;
+	r.u.w.sensor = sensor;
+	r.u.w.addr = addr;
+	r.u.w.caps = w->caps;
+	r.u.w.period = w->period;
+	r.u.w.start = w->start;
+	qsum(&r.u.w.q[0], &w->temp);
+	qsum(&r.u.w.q[1], &w->humi);
+	if (outq_active)
+		outq_push(&r);
+	else
+		render_window(&r.u.w);
+}
+
+void out_render(const struct out_rec *r)
+{
+	if (r->kind == OUT_REC_SAMPLE)
+		render_sample(&r->u.s);
+	else
+		render_window(&r->u.w);
+}
+
+// with a queue, its writer decides when to write
+void out_flush(void)
+{
+	if (!outq_active)
+		out_write();
+}
+
+void out_write(void)
+{
+	size_t done = 0;
+
+	while (done < out_len) {
+		ssize_t n = write(out_fd, out_buf + done, out_len - done);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;      // nowhere to go, drop it like stdio would
+		done += n;
+	}
+	out_len = 0;
+}
+
+static void bench_sample(struct sample *s, uint32_t *seed)
+{
+	*seed = *seed * 1103515245u + 12345u;
+	s->temp = (int32_t)*seed / 2147483648.0f * 60.0f;
+	*seed = *seed * 1103515245u + 12345u;
+	s->humi = (*seed >> 8) / 16777216.0f * 100.0f;
+}
+
+// Records/s of out_sample() against the stdio path, both to /dev/null,
+// and a check that both render the same bytes (through temp files)
+void out_bench(FILE *f, size_t n)
+{
+	struct sample s = { .status = 3, .mask = 3, .nconv = 1, .nok = 1 };
+	FILE *ref = tmpfile(), *null = fopen("/dev/null", "w");
+	FILE *fast = tmpfile();
+	int saved_fd = out_fd;
+	uint64_t t0, t_stdio, t_fast;
+	uint32_t seed;
+	size_t i, diff = 0;
+
+	if (!ref || !fast || !null) {
+		fprintf(stderr, "Error: Could not open bench files\n");
+		goto out;
+	}
+	out_flush();
+
+	seed = 1;
+	t0 = lat_now();
+	for (i = 0; i < n; i++) {
+		bench_sample(&s, &seed);
+		out_sample_stdio(null, &s);
+	}
+	fflush(null);
+	t_stdio = lat_now() - t0;
+
+	out_fd = fileno(null);
+	seed = 1;
+	t0 = lat_now();
+	for (i = 0; i < n; i++) {
+		bench_sample(&s, &seed);
+		out_sample(&s);
+	}
+	out_flush();
+	t_fast = lat_now() - t0;
+
+	out_fd = fileno(fast);
+	seed = 1;
+	for (i = 0; i < n; i++) {
+		bench_sample(&s, &seed);
+		out_sample(&s);
+		out_sample_stdio(ref, &s);
+	}
+	out_flush();
+	fflush(ref);
+	rewind(ref);
+	lseek(fileno(fast), 0, SEEK_SET);
+	for (;;) {
+		char a[4096], b[4096];
+		size_t na = fread(a, 1, sizeof(a), ref);
+		ssize_t nb = read(fileno(fast), b, sizeof(b));
+
+		if (nb < 0 || (size_t)nb != na || memcmp(a, b, na)) {
+			diff = 1;
+			break;
+		}
+		if (na == 0)
+			break;
+	}
+
+	fprintf(f, "stdio  %10.0f records/s\n", n * 1e9 / t_stdio);
+	fprintf(f, "buffer %10.0f records/s (%.1fx), output %s\n",
+		n * 1e9 / t_fast, (double)t_stdio / t_fast,
+		diff ? "DIFFERS" : "identical");
+out:
+	out_fd = saved_fd;
+	if (ref)
+		fclose(ref);
+	if (fast)
+		fclose(fast);
+	if (null)
+		fclose(null);
+}
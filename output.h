@@ -0,0 +1,111 @@
+/* ---------------------------------------------------------------------
+ *                           output.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Sample records and their output formats
+ * --------------------------------------------------------------------*/
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "psychro.h"
+#include "stats.h"
+
+// one reading of one sensor (possibly reduced from several conversions)
+struct sample {
+	uint64_t ts;            ///< CLOCK_REALTIME, ns
+	const char *sensor;     ///< sensor (driver) name
+	uint8_t addr;           ///< i2c address
+	uint8_t type;           ///< enum sensor_type
+	uint32_t id;            ///< sensor index in a continuous run
+	int8_t status;          ///< valid quantities as readsensor_fn returns, -1 on error
+	uint8_t mask;           ///< quantities to print, subset of status
+	uint16_t nconv;         ///< conversions asked for (-n)
+	uint16_t nok;           ///< conversions that succeeded
+	float temp;
+	float humi;
+	float temp_sd;          ///< spread of the conversions, with nconv > 1
+	float humi_sd;
+	uint32_t raw_t;         ///< raw counts of the last conversion
+	uint32_t raw_h;
+	uint8_t flags;          ///< SAMPLE_* (--fuse)
+	uint8_t derived;        ///< dp is there (--derived)
+	struct psychro dp;      ///< from temp and humi
+};
+
+#define SAMPLE_DRIFT        0x01    ///< this sensor is left out of the fusion
+#define SAMPLE_DISAGREE     0x02    ///< the fused sensors disagree
+#define SAMPLE_FUSED        0x04    ///< fused: nok of nconv sensors used
+
+// Change-only emission: a quantity is printed only if it moved by more
+// than its threshold since it was last printed, or when the heartbeat
+// interval since then elapsed. Thresholds apply to temp and humi apart.
+struct deadband {
+	uint8_t on;
+	float delta[2];         ///< temp (deg C), humi (%)
+	uint64_t heartbeat;     ///< ns, 0: none
+};
+
+// per sensor: what was printed last
+struct deadband_state {
+	uint8_t have;           ///< quantities printed at least once
+	float last[2];
+	uint64_t last_ts[2];
+};
+
+uint8_t deadband_mask(const struct deadband *db, struct deadband_state *st,
+		      const struct sample *s);
+
+enum out_format {
+	OUT_TEXT,               ///< Temp=../Humi=.. or bare (-b/-r)
+	OUT_JSON,               ///< JSON lines
+	OUT_CSV,                ///< with a header line
+	OUT_INFLUX,             ///< InfluxDB line protocol, ns timestamps
+};
+
+// window statistics, summarised when the window closes
+struct qsum {
+	double mean, sd, min, max;
+	double p[QSTATS_NQ];    ///< p5, p50, p95
+	uint32_t n;
+};
+
+struct window_rec {
+	const char *sensor;
+	uint8_t addr;
+	uint8_t caps;
+	uint32_t period;        ///< seconds
+	uint64_t start;         ///< unix seconds
+	struct qsum q[2];       ///< temp, humi
+};
+
+// what goes through the output queue
+#define OUT_REC_SAMPLE      0
+#define OUT_REC_WINDOW      1
+
+struct out_rec {
+	uint8_t kind;
+	uint32_t nroll;         ///< samples rolled into this one (rollup policy)
+	union {
+		struct sample s;
+		struct window_rec w;
+	} u;
+};
+
+int out_format_parse(const char *name);     ///< enum out_format, -1 if unknown
+void out_init(uint8_t bare_fmt, const char *deg, enum out_format fmt,
+	      uint8_t derived);
+void out_sample(const struct sample *s);
+void out_window(const char *sensor, uint8_t addr, const struct window *w);
+void out_flush(void);
+void out_render(const struct out_rec *r);   ///< into the buffer
+void out_write(void);                       ///< the buffer, one write(2)
+void out_bench(FILE *f, size_t n);
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,228 @@
+/* ---------------------------------------------------------------------
+ *                           outq.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Output queue. The sampling loop only copies its records
+ *              into a bounded ring; a writer thread takes them out in
+ *              batches, renders them (output.c) and writes each batch
+ *              with one write(2), when a batch is full or flush_ms
+ *              after the previous write. A consumer that stalls blocks
+ *              the writer, never the sampling loop: once the ring is
+ *              full, the overflow policy decides which record is lost.
+ * --------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "outq.h"
+
+#define OUTQ_BATCH_MAX      256     ///< records per write, at most
+
+int outq_active;
+
+static struct out_rec *ring;
+static struct out_rec *batch_buf;   // writer's copy of a batch
+static size_t cap, head, count;     // head: oldest record
+static size_t batch;
+static enum outq_policy policy;
+static unsigned flush_ms;
+static int stopping;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake;
+static pthread_t writer;
+
+// counters, under the lock
+static uint64_t queued, dropped, rolled;
+static size_t max_depth;
+
+static const char *const policy_names[] = {
+	[OUTQ_DROP_OLDEST] = "drop-oldest",
+	[OUTQ_DROP_NEWEST] = "drop-newest",
+	[OUTQ_ROLLUP]      = "rollup",
+};
+
+int outq_policy_parse(const char *name)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++)
+		if (!strcmp(name, policy_names[i]))
+			return i;
+	return -1;
+}
+
+static struct out_rec *slot(size_t i)
+{
+	return &ring[(head + i) % cap];
+}
+
+// average r into the newest queued reading of the same sensor
+static int rollup(const struct out_rec *r)
+{
+	const struct sample *s = &r->u.s;
+	size_t i = count;
+
+	if (r->kind != OUT_REC_SAMPLE || s->status <= 0)
+		return 0;
+	while (i--) {
+		struct out_rec *e = slot(i);
+		struct sample *d = &e->u.s;
+		float n;
+
+		if (e->kind != OUT_REC_SAMPLE || d->id != s->id || d->addr != s->addr ||
+		    d->status != s->status || d->mask != s->mask ||
+		    d->flags != s->flags || d->derived != s->derived)
+			continue;
+		n = ++e->nroll + 1;
+		d->temp += (s->temp - d->temp) / n;
+		d->humi += (s->humi - d->humi) / n;
+		if (d->derived) {
+			d->dp.dew += (s->dp.dew - d->dp.dew) / n;
+			d->dp.ah += (s->dp.ah - d->dp.ah) / n;
+			d->dp.humidex += (s->dp.humidex - d->dp.humidex) / n;
+			d->dp.heat_index += (s->dp.heat_index - d->dp.heat_index) / n;
+			d->dp.vpd += (s->dp.vpd - d->dp.vpd) / n;
+		}
+		d->ts = s->ts;
+		rolled++;
+		return 1;
+	}
+	return 0;
+}
+
+void outq_push(const struct out_rec *r)
+{
+	pthread_mutex_lock(&lock);
+	if (count == cap) {
+		if (policy == OUTQ_ROLLUP && rollup(r)) {
+			pthread_mutex_unlock(&lock);
+			return;
+		}
+		dropped++;
+		if (policy == OUTQ_DROP_NEWEST) {
+			pthread_mutex_unlock(&lock);
+			return;
+		}
+		head = (head + 1) % cap;
+		count--;
+	}
+	*slot(count++) = *r;
+	queued++;
+	if (count > max_depth)
+		max_depth = count;
+	if (count == batch)
+		pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+}
+
+static void deadline(struct timespec *ts, unsigned ms)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+static void *outq_writer(void *arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		struct timespec until;
+		size_t i, n;
+
+		deadline(&until, flush_ms);
+		while (count < batch && !stopping)
+			if (pthread_cond_timedwait(&wake, &lock, &until) == ETIMEDOUT)
+				break;
+		n = count < batch ? count : batch;
+		for (i = 0; i < n; i++)
+			batch_buf[i] = *slot(i);
+		head = (head + n) % cap;
+		count -= n;
+		if (n == 0 && stopping)
+			break;
+		pthread_mutex_unlock(&lock);
+
+		// the slow part, without the lock
+		for (i = 0; i < n; i++)
+			out_render(&batch_buf[i]);
+		out_write();
+		pthread_mutex_lock(&lock);
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+int outq_start(size_t n, enum outq_policy pol, unsigned ms)
+{
+	pthread_condattr_t ca;
+	sigset_t set, old;
+	int err;
+
+	ring = arena_alloc(n * sizeof(*ring));
+	batch = n / 2 < OUTQ_BATCH_MAX ? n / 2 : OUTQ_BATCH_MAX;
+	if (batch == 0)
+		batch = 1;
+	batch_buf = arena_alloc(batch * sizeof(*batch_buf));
+	if (!ring || !batch_buf) {
+		fprintf(stderr, "Error: out of memory\n");
+		return -1;
+	}
+	cap = n;
+	policy = pol;
+	flush_ms = ms;
+
+	pthread_condattr_init(&ca);
+	pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+	pthread_cond_init(&wake, &ca);
+	pthread_condattr_destroy(&ca);
+	// the signals are for the main and I/O threads, not the writer
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &set, &old);
+	err = pthread_create(&writer, NULL, outq_writer, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (err) {
+		fprintf(stderr, "Error: Could not start the output writer\n");
+		return -1;
+	}
+	outq_active = 1;
+	atexit(outq_stop);
+	return 0;
+}
+
+// drains the queue and stops the writer
+void outq_stop(void)
+{
+	if (!outq_active)
+		return;
+	pthread_mutex_lock(&lock);
+	stopping = 1;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+	pthread_join(writer, NULL);
+	outq_active = 0;
+
+	if (dropped || rolled)
+		fprintf(stderr, "Output queue: %llu records, %llu dropped, "
+			"%llu rolled up (%s), max depth %zu/%zu\n",
+			(unsigned long long)queued, (unsigned long long)dropped,
+			(unsigned long long)rolled, policy_names[policy],
+			max_depth, cap);
+}
@@ -0,0 +1,33 @@
+/* ---------------------------------------------------------------------
+ *                           outq.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Bounded output queue between the sampling loop and a
+ *              writer thread, with an overflow policy
+ * --------------------------------------------------------------------*/
+
+#ifndef OUTQ_H
+#define OUTQ_H
+
+#include <stddef.h>
+
+#include "output.h"
+
+// what to do with a record when the queue is full
+enum outq_policy {
+	OUTQ_DROP_OLDEST,       ///< make room by dropping the oldest record
+	OUTQ_DROP_NEWEST,       ///< drop the record being queued
+	OUTQ_ROLLUP,            ///< average it into the newest record of its sensor
+};
+
+extern int outq_active;
+
+int outq_policy_parse(const char *name);    ///< enum outq_policy, -1 if unknown
+int outq_start(size_t cap, enum outq_policy policy, unsigned flush_ms);
+void outq_push(const struct out_rec *r);
+void outq_stop(void);
+
+#endif /* OUTQ_H */
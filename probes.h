@@ -0,0 +1,69 @@
+/* ---------------------------------------------------------------------
+ *                           probes.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Optional USDT (sys/sdt.h) probes, enabled with
+ *              make SDT=1. Without it all probes compile to nothing.
+ *
+ *   room_temp:xfer   (addr, op, cmd, result, duration_ns)
+ *   room_temp:wait   (addr, kind, arg, result, duration_ns)
+ *                    kind 0: fixed sleep, arg = requested us
+ *                    kind 1: busy wait,   arg = retries
+ *   room_temp:sample (addr, result, duration_ns)
+ *
+ * Example:
+ *   bpftrace -e 'usdt:./room_temp:room_temp:xfer
+ *                { @[arg0, arg2] = hist(arg4 / 1000); }'
+ * --------------------------------------------------------------------*/
+
+#ifndef PROBES_H
+#define PROBES_H
+
+// values of the op argument of the xfer probe
+enum probe_op {
+	PROBE_OP_READ_BYTE = 1,
+	PROBE_OP_WRITE_BYTE,
+	PROBE_OP_READ_BYTE_DATA,
+	PROBE_OP_WRITE_BYTE_DATA,
+	PROBE_OP_READ_WORD_DATA,
+	PROBE_OP_READ_BLOCK,
+	PROBE_OP_WRITE_BLOCK,
+};
+
+#if defined(HAVE_SDT)
+
+// Semaphores let us skip argument set-up while no tracer is attached;
+// the probe site itself is a single nop.
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define PROBE_SEMAPHORE(name) \
+	unsigned short room_temp_##name##_semaphore \
+	__attribute__((unused)) __attribute__((section(".probes")))
+
+extern PROBE_SEMAPHORE(xfer);
+extern PROBE_SEMAPHORE(wait);
+extern PROBE_SEMAPHORE(sample);
+
+#define PROBE_ENABLED(name)  __builtin_expect(room_temp_##name##_semaphore, 0)
+#define PROBE3(name, a1, a2, a3) \
+	DTRACE_PROBE3(room_temp, name, a1, a2, a3)
+#define PROBE5(name, a1, a2, a3, a4, a5) \
+	DTRACE_PROBE5(room_temp, name, a1, a2, a3, a4, a5)
+
+#else
+
+// arguments stay referenced (in dead code) to avoid unused warnings
+#define PROBE_ENABLED(name)  0
+#define PROBE3(name, a1, a2, a3) \
+	do { if (0) { (void)(a1); (void)(a2); (void)(a3); } } while (0)
+#define PROBE5(name, a1, a2, a3, a4, a5) \
+	do { if (0) { (void)(a1); (void)(a2); (void)(a3); \
+		      (void)(a4); (void)(a5); } } while (0)
+
+#endif /* HAVE_SDT */
+
+#endif /* PROBES_H */
@@ -0,0 +1,103 @@
+/* ---------------------------------------------------------------------
+ *                           profile.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Attribution of the process wall time, from exec to exit,
+ *              to the phases of a single invocation (--profile).
+ *              prof_mark(p) charges the time since the previous mark
+ *              to phase p. Marks are always taken (a few clock reads
+ *              per run); the report is printed only when enabled.
+ * --------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "profile.h"
+#include "latency.h"
+
+static const char *prof_names[PROF_PHASES] = {
+	"pre-main", "args", "open", "ioctl", "sensor",
+	"setlocale", "degstr", "output", "exit"
+};
+
+static uint64_t prof_ns[PROF_PHASES];
+static uint64_t prof_last;
+static int prof_enabled;
+
+static uint64_t cputime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Runs before main(). Nothing of ours ran yet, so the CPU time consumed
+// so far is exec + ld.so relocation + libc start-up. Those are CPU bound,
+// which makes it a fair estimate of the pre-main wall time (the exec
+// moment itself is only known to the kernel, in 10 ms ticks).
+__attribute__((constructor(101)))
+static void prof_start(void)
+{
+	prof_last = lat_now();
+	prof_ns[PROF_PREMAIN] = cputime_ns();
+}
+
+void prof_mark(enum prof_phase phase)
+{
+	uint64_t now = lat_now();
+
+	prof_ns[phase] += now - prof_last;
+	prof_last = now;
+}
+
+static void prof_line(const char *name, uint64_t ns, uint64_t total)
+{
+	fprintf(stderr, "  %-10s %9.3f ms %5.1f%%\n", name, ns / 1e6,
+		total ? 100.0 * ns / total : 0.0);
+}
+
+static void prof_report(void)
+{
+	const struct lat_sensor *ls;
+	struct rusage ru;
+	uint64_t total = 0;
+	int p;
+
+	fflush(stdout);
+	prof_mark(PROF_EXIT);
+
+	for (p = 0; p < PROF_PHASES; p++)
+		total += prof_ns[p];
+
+	fprintf(stderr, "Profile (wall time, exec to exit):\n");
+	for (p = 0; p < PROF_PHASES; p++) {
+		prof_line(prof_names[p], prof_ns[p], total);
+		if (p != PROF_SENSOR)
+			continue;
+		for (ls = lat_first(); ls; ls = ls->next) {
+			prof_line("  bus xfer", ls->phase[LAT_XFER].sum_us * 1000, total);
+			prof_line("  sleep", ls->phase[LAT_SLEEP].sum_us * 1000, total);
+		}
+	}
+	prof_line("total", total, total);
+
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+		fprintf(stderr, "  page faults %ld minor / %ld major, "
+			"context switches %ld voluntary / %ld involuntary\n",
+			ru.ru_minflt, ru.ru_majflt, ru.ru_nvcsw, ru.ru_nivcsw);
+}
+
+void prof_enable(void)
+{
+	if (!prof_enabled) {
+		prof_enabled = 1;
+		atexit(prof_report);
+	}
+}
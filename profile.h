@@ -0,0 +1,31 @@
+/* ---------------------------------------------------------------------
+ *                           profile.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Attribution of the process wall time, from exec to exit,
+ *              to the phases of a single invocation (--profile)
+ * --------------------------------------------------------------------*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+enum prof_phase {
+	PROF_PREMAIN = 0,   ///< exec, dynamic loading, libc init
+	PROF_ARGS,          ///< option parsing
+	PROF_OPEN,          ///< open() of the bus device
+	PROF_IOCTL,         ///< I2C_SLAVE ioctl
+	PROF_SENSOR,        ///< readsensorfn()
+	PROF_LOCALE,        ///< setlocale()
+	PROF_DEGSTR,        ///< set_degstr() (nl_langinfo + iconv)
+	PROF_OUTPUT,        ///< formatting and writing the result
+	PROF_EXIT,          ///< flushing stdio and exit handlers
+	PROF_PHASES
+};
+
+void prof_mark(enum prof_phase phase);
+void prof_enable(void);
+
+#endif /* PROFILE_H */
@@ -0,0 +1,227 @@
+/* ---------------------------------------------------------------------
+ *                           psychro.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Dew point, absolute humidity, humidex, heat index and
+ *              vapour pressure deficit from temperature and humidity.
+ *              All of them follow from the saturation vapour pressure
+ *              es(t) (Magnus form, Alduchov & Eskridge 1996) and its
+ *              inverse. Instead of an exp() and a log() per reading,
+ *              es is taken from a table in steps of ES_STEP deg C, and
+ *              the dew point from a table over the vapour pressure e in
+ *              2^DEW_K steps per octave, indexed by the exponent and top
+ *              mantissa bits of e (a piecewise linear log2); both are
+ *              interpolated linearly. Over -40..125 deg C that is within
+ *              0.005 deg C of the libm dew point and 0.05 % of es (make
+ *              bench-derived measures both); outside the tables
+ *              psychro() falls back to libm. Absolute humidity, humidex
+ *              and heat index (NWS: Rothfusz regression with its
+ *              corrections) are plain arithmetic on top.
+ * --------------------------------------------------------------------*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency.h"
+#include "psychro.h"
+
+#define MAGNUS_A            6.1094  ///< hPa
+#define MAGNUS_B            17.625
+#define MAGNUS_C            243.04  ///< deg C
+
+#define ES_MIN              -60.0f  ///< deg C, first table entry
+#define ES_STEP             0.5f
+#define ES_N                381     ///< up to 130 deg C
+
+#define DEW_K               5       ///< 2^DEW_K entries per octave of e
+#define DEW_SHIFT           (23 - DEW_K)
+#define DEW_E_MIN           0.015625f   ///< hPa, 2^-6, about -62 deg C
+#define DEW_N               (18 << DEW_K)   ///< up to 2^12 hPa
+
+static float es_tab[ES_N];          ///< hPa
+static float dew_tab[DEW_N + 1];    ///< deg C
+static uint32_t dew_base;           ///< DEW_E_MIN >> DEW_SHIFT
+
+static uint32_t float_bits(float v)
+{
+	uint32_t u;
+
+	memcpy(&u, &v, sizeof(u));
+	return u;
+}
+
+static float bits_float(uint32_t u)
+{
+	float v;
+
+	memcpy(&v, &u, sizeof(v));
+	return v;
+}
+
+static double es_exact(double t)
+{
+	return MAGNUS_A * exp(MAGNUS_B * t / (t + MAGNUS_C));
+}
+
+static double dew_exact(double e)
+{
+	double l = log(e / MAGNUS_A);
+
+	return MAGNUS_C * l / (MAGNUS_B - l);
+}
+
+void psychro_init(void)
+{
+	int i;
+
+	for (i = 0; i < ES_N; i++)
+		es_tab[i] = es_exact(ES_MIN + i * ES_STEP);
+	dew_base = float_bits(DEW_E_MIN) >> DEW_SHIFT;
+	for (i = 0; i <= DEW_N; i++)
+		dew_tab[i] = dew_exact(bits_float((dew_base + i) << DEW_SHIFT));
+}
+
+static float clamp_rh(float rh)
+{
+	// a sensor can read a bit beyond 0..100 %, and at 0 % there is
+	// no dew point
+	return rh < 0.01f ? 0.01f : rh > 100.0f ? 100.0f : rh;
+}
+
+// the derived quantities besides the dew point, e and es in hPa
+static void derive(float t, float rh, float e, float es, struct psychro *p)
+{
+	float tf = t * 1.8f + 32.0f, hi;
+
+	p->ah = 216.7f * e / (t + 273.15f);
+	p->humidex = t + 0.5555f * (e - 10.0f);
+	p->vpd = (es - e) * 0.1f;
+
+	// NWS heat index, in deg F
+	hi = 0.5f * (tf + 61.0f + (tf - 68.0f) * 1.2f + rh * 0.094f);
+	if (hi + tf >= 160.0f) {
+		hi = -42.379f + 2.04901523f * tf + 10.14333127f * rh
+			- 0.22475541f * tf * rh - 0.00683783f * tf * tf
+			- 0.05481717f * rh * rh + 0.00122874f * tf * tf * rh
+			+ 0.00085282f * tf * rh * rh - 0.00000199f * tf * tf * rh * rh;
+		if (rh < 13.0f && tf >= 80.0f && tf <= 112.0f)
+			hi -= (13.0f - rh) / 4.0f * sqrtf((17.0f - fabsf(tf - 95.0f)) / 17.0f);
+		else if (rh > 85.0f && tf >= 80.0f && tf <= 87.0f)
+			hi += (rh - 85.0f) / 10.0f * (87.0f - tf) / 5.0f;
+	}
+	p->heat_index = (hi - 32.0f) * (1.0f / 1.8f);
+}
+
+void psychro(float t, float rh, struct psychro *p)
+{
+	float x = (t - ES_MIN) * (1.0f / ES_STEP), es, e;
+	uint32_t u, j;
+	int i;
+
+	if (!(x >= 0 && x < ES_N - 1)) {
+		psychro_exact(t, rh, p);
+		return;
+	}
+	rh = clamp_rh(rh);
+	i = (int)x;
+	es = es_tab[i] + (x - i) * (es_tab[i + 1] - es_tab[i]);
+	e = es * rh * 0.01f;
+	derive(t, rh, e, es, p);
+
+	// within an entry, e is linear in the low mantissa bits
+	u = float_bits(e);
+	j = (u >> DEW_SHIFT) - dew_base;
+	if (j >= DEW_N) {
+		p->dew = dew_exact(e);
+		return;
+	}
+	x = (u & ((1u << DEW_SHIFT) - 1)) * (1.0f / (1u << DEW_SHIFT));
+	p->dew = dew_tab[j] + x * (dew_tab[j + 1] - dew_tab[j]);
+}
+
+void psychro_exact(float t, float rh, struct psychro *p)
+{
+	double es, e;
+
+	rh = clamp_rh(rh);
+	es = es_exact(t);
+	e = es * rh / 100.0;
+	derive(t, rh, e, es, p);
+	p->dew = dew_exact(e);
+}
+
+static volatile float bench_sink;    ///< keeps the bench loops
+
+// Readings/s of psychro() and psychro_exact() over n pseudo-random
+// pairs, and their largest differences over the sensors' range
+void psychro_bench(FILE *f, size_t n)
+{
+	struct psychro p, q, d = { 0 };
+	uint32_t seed = 1;
+	uint64_t t0, t_exact, t_fast;
+	float *pairs = malloc(2 * n * sizeof(*pairs)), sum = 0;
+	double es_rel = 0;
+	size_t i;
+	int ti, hi;
+
+	if (!pairs) {
+		fprintf(stderr, "Error: out of memory\n");
+		return;
+	}
+	psychro_init();
+	for (i = 0; i < n; i++) {
+		seed = seed * 1103515245u + 12345u;
+		pairs[2 * i] = -20.0f + (seed >> 8) / 16777216.0f * 70.0f;
+		seed = seed * 1103515245u + 12345u;
+		pairs[2 * i + 1] = (seed >> 8) / 16777216.0f * 100.0f;
+	}
+
+	t0 = lat_now();
+	for (i = 0; i < n; i++) {
+		psychro_exact(pairs[2 * i], pairs[2 * i + 1], &p);
+		sum += p.dew + p.vpd;
+	}
+	t_exact = lat_now() - t0;
+	t0 = lat_now();
+	for (i = 0; i < n; i++) {
+		psychro(pairs[2 * i], pairs[2 * i + 1], &p);
+		sum -= p.dew + p.vpd;
+	}
+	t_fast = lat_now() - t0;
+	bench_sink = sum;
+	free(pairs);
+
+	// -40..125 deg C in 0.01 steps, 1..100 % in 0.5 steps
+	for (ti = -4000; ti <= 12500; ti++) {
+		float t = ti * 0.01f;
+		double es = es_exact(t);
+
+		for (hi = 2; hi <= 200; hi++) {
+			float rh = hi * 0.5f;
+
+			psychro(t, rh, &p);
+			psychro_exact(t, rh, &q);
+			d.dew = fmaxf(d.dew, fabsf(p.dew - q.dew));
+			d.ah = fmaxf(d.ah, fabsf(p.ah - q.ah));
+			d.humidex = fmaxf(d.humidex, fabsf(p.humidex - q.humidex));
+			d.heat_index = fmaxf(d.heat_index, fabsf(p.heat_index - q.heat_index));
+			d.vpd = fmaxf(d.vpd, fabsf(p.vpd - q.vpd));
+		}
+		// at 100 % es = e, from the absolute humidity
+		psychro(t, 100.0f, &p);
+		es_rel = fmax(es_rel, fabs(p.ah * (t + 273.15) / 216.7 / es - 1));
+	}
+
+	fprintf(f, "libm   %10.0f readings/s\n", n * 1e9 / t_exact);
+	fprintf(f, "tables %10.0f readings/s (%.1fx)\n", n * 1e9 / t_fast,
+		(double)t_exact / t_fast);
+	fprintf(f, "largest difference, -40..125 deg C, 1..100 %%:\n"
+		"  es %.4f %%, dew point %.4f deg C, absolute humidity %.4f g/m3,\n"
+		"  humidex %.4f deg C, heat index %.4f deg C, VPD %.5f kPa\n",
+		es_rel * 100, d.dew, d.ah, d.humidex, d.heat_index, d.vpd);
+}
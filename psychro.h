@@ -0,0 +1,37 @@
+/* ---------------------------------------------------------------------
+ *                           psychro.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Quantities derived from a temperature/humidity pair:
+ *              dew point, absolute humidity, humidex, heat index and
+ *              vapour pressure deficit
+ * --------------------------------------------------------------------*/
+
+#ifndef PSYCHRO_H
+#define PSYCHRO_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+struct psychro {
+	float dew;              ///< dew point, deg C
+	float ah;               ///< absolute humidity, g/m3
+	float humidex;          ///< Environment Canada humidex, deg C
+	float heat_index;       ///< NWS heat index, deg C
+	float vpd;              ///< vapour pressure deficit, kPa
+};
+
+void psychro_init(void);    ///< the tables, once before psychro()
+
+// t in deg C, rh in %: from tables, no exp/log in the sensor's range
+void psychro(float t, float rh, struct psychro *p);
+// the same with libm, the reference
+void psychro_exact(float t, float rh, struct psychro *p);
+
+// readings/s of both and the largest differences between them
+void psychro_bench(FILE *f, size_t n);
+
+#endif /* PSYCHRO_H */
@@ -0,0 +1,72 @@
+/* ---------------------------------------------------------------------
+ *                           raw.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Raw sensor counts, their conversion to engineering
+ *              units and the raw log format. Raw counts are exact and
+ *              half the size of the converted floats; conversion can
+ *              be deferred to query time with raw_convert().
+ * --------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <string.h>
+
+#include "raw.h"
+
+const struct raw_scale raw_scales[SENSOR_TYPES] = {
+	[SENSOR_NONE]    = { 0, 0, 0, 0 },
+	// 12 bit two's complement in the upper bits of a 16 bit count,
+	// treated as unsigned like the driver always did
+	[SENSOR_MCP9801] = { 0, 1.0f / 256, 0, 0 },
+	// 20 bit counts
+	[SENSOR_AHT10]   = { -50, 200.0f / 0x100000, 0, 100.0f / 0x100000 },
+	// 16 bit counts, in double
+	[SENSOR_SHT30]   = { -45, 175.0f / 65535, 0, 100.0f / 65535, 175, 100, 65535 },
+};
+
+// Logs hold long runs of one sensor type; converting run by run keeps
+// the inner loops free of table lookups and branches, so that the
+// compiler can vectorise them.
+void raw_convert(const struct raw_rec *in, size_t n, float *temp, float *humi)
+{
+	size_t i = 0, end;
+
+	while (i < n) {
+		const unsigned type = RAW_TYPE(&in[i]);
+		const struct raw_scale sc = raw_scales[type < SENSOR_TYPES ? type : 0];
+		size_t j;
+
+		for (end = i + 1; end < n && RAW_TYPE(&in[end]) == type; end++)
+			;
+		if (sc.div) {
+			for (j = i; j < end; j++) {
+				temp[j] = sc.t_off + sc.t_mul * (in[j].t & RAW_COUNT_MASK) / sc.div;
+				humi[j] = sc.h_off + sc.h_mul * (in[j].h & RAW_COUNT_MASK) / sc.div;
+			}
+		} else {
+			for (j = i; j < end; j++) {
+				temp[j] = sc.t_off + sc.t_scale * (float)(in[j].t & RAW_COUNT_MASK);
+				humi[j] = sc.h_off + sc.h_scale * (float)(in[j].h & RAW_COUNT_MASK);
+			}
+		}
+		i = end;
+	}
+}
+
+FILE *raw_log_open(const char *path)
+{
+	FILE *f = fopen(path, "ab");
+
+	if (!f)
+		fprintf(stderr, "Error: Could not open raw log `%s': %s\n",
+			path, strerror(errno));
+	return f;
+}
+
+int raw_log_write(FILE *f, const struct raw_rec *r)
+{
+	return fwrite(r, sizeof(*r), 1, f) == 1 ? 0 : -1;
+}
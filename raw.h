@@ -0,0 +1,88 @@
+/* ---------------------------------------------------------------------
+ *                           raw.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Raw sensor counts, their conversion to engineering
+ *              units and the raw log format
+ * --------------------------------------------------------------------*/
+
+#ifndef RAW_H
+#define RAW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum sensor_type {
+	SENSOR_NONE = 0,        ///< also: a fused reading (--fuse)
+	SENSOR_MCP9801,
+	SENSOR_AHT10,
+	SENSOR_SHT30,
+	SENSOR_TYPES
+};
+
+// All supported sensors convert linearly: value = off + scale * count,
+// in float. Where div is set (SHT30) it is off + mul * count / div in
+// double instead, as that driver always did, so that the printed
+// readings round exactly as they did; scale is then only the step.
+struct raw_scale {
+	float t_off;
+	float t_scale;
+	float h_off;
+	float h_scale;
+	double t_mul, h_mul, div;
+};
+
+extern const struct raw_scale raw_scales[SENSOR_TYPES];
+
+static inline float raw_temp(enum sensor_type type, uint32_t count)
+{
+	const struct raw_scale *sc = &raw_scales[type];
+
+	if (sc->div)
+		return sc->t_off + sc->t_mul * count / sc->div;
+	return sc->t_off + sc->t_scale * (float)count;
+}
+
+static inline float raw_humi(enum sensor_type type, uint32_t count)
+{
+	const struct raw_scale *sc = &raw_scales[type];
+
+	if (sc->div)
+		return sc->h_off + sc->h_mul * count / sc->div;
+	return sc->h_off + sc->h_scale * (float)count;
+}
+
+// Raw log record, 16 bytes in host byte order (little endian on the Pi).
+// Counts are at most 20 bits, the upper bits carry the sample identity.
+struct raw_rec {
+	uint64_t ts;    ///< CLOCK_REALTIME, ns
+	uint32_t t;     ///< bits 0-19: temperature count, 24-31: i2c address
+	uint32_t h;     ///< bits 0-19: humidity count, 24-27: sensor type,
+			///< 28-31: status (valid quantities)
+};
+
+#define RAW_COUNT_MASK      0x000fffffu
+#define RAW_ADDR(r)         ((r)->t >> 24)
+#define RAW_TYPE(r)         (((r)->h >> 24) & 0x0f)
+#define RAW_STATUS(r)       ((r)->h >> 28)
+
+static inline void raw_pack(struct raw_rec *r, uint64_t ts, uint8_t addr,
+			    enum sensor_type type, uint8_t status,
+			    uint32_t t, uint32_t h)
+{
+	r->ts = ts;
+	r->t = (t & RAW_COUNT_MASK) | (uint32_t)addr << 24;
+	r->h = (h & RAW_COUNT_MASK) | (uint32_t)type << 24 |
+		(uint32_t)(status & 0x0f) << 28;
+}
+
+void raw_convert(const struct raw_rec *in, size_t n, float *temp, float *humi);
+
+FILE *raw_log_open(const char *path);
+int raw_log_write(FILE *f, const struct raw_rec *r);
+
+#endif /* RAW_H */
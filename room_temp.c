@@ -21,20 +21,45 @@
 
 
 #include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <locale.h>
 #include <langinfo.h>
 #include <iconv.h>
+#include <strings.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <linux/i2c-dev.h>
-#include <i2c/smbus.h>
+
+#include "allocguard.h"
+#include "arena.h"
+#include "bus.h"
+#include "db.h"
+#include "decode.h"
+#include "export.h"
+#include "filter.h"
+#include "fuse.h"
+#include "journal.h"
+#include "latency.h"
+#include "output.h"
+#include "outq.h"
+#include "profile.h"
+#include "psychro.h"
+#include "raw.h"
+#include "rt.h"
+#include "schedule.h"
+#include "spsc.h"
+#include "stats.h"
+#include "store.h"
+#include "trace.h"
 
 
 #define I2CBUS_FILE         "/dev/i2c-1"
@@ -46,9 +71,14 @@
 #define MCP9801_CONV_TOUT_MS    330
 
 #define TOUT_10_MS          10
+#define TOUT_80_MS          80
 #define TOUT_20_MS          20
 #define BUSY_WAIT_RETRIES   20
 
+#define OVERSAMPLE_MAX      1000
+#define MAX_WINDOWS         4
+#define RAW_BATCH           4096    ///< raw records converted at once
+
 #define AHTX0_ADDR_DEFAULT      0x38    ///< AHT default i2c address
 #define AHTX0_ADDR_ALTERNATE    0x39    ///< AHT alternate i2c address
 #define AHTX0_CMD_CALIBRATE     0xE1    ///< Calibration command
@@ -62,6 +92,11 @@
 #define SHT30_CMD_MEAS_HREP_CSTRETCH_LSB 0x06   ///< --
 #define SHT30_CMD_MEAS_HREP_MSB 0x24    ///< Measurement High Repeatability with Clock Stretch Disabled
 #define SHT30_CMD_MEAS_HREP_LSB 0x00    ///< --
+#define SHT30_CMD_MEAS_MREP_LSB 0x0B    ///< Medium Repeatability, Clock Stretch Disabled
+#define SHT30_CMD_MEAS_LREP_LSB 0x16    ///< Low Repeatability, Clock Stretch Disabled
+#define SHT30_HREP_MS           20      ///< max. 15.5 ms conversion, plus margin
+#define SHT30_MREP_MS           8       ///< max. 6.5 ms
+#define SHT30_LREP_MS           5       ///< max. 4.5 ms
 
 //#define DEBUG
 //#define DEBUG_GET_STATUS
@@ -74,11 +109,45 @@
 //		 1 if only temperature, 2 if humidity, 3 if both
 typedef int8_t(*readsensor_fn)(int file, float * temp, float * humi);
 
-int8_t read_mcp9801(int file, float * temp, float * humi)
+// one conversion, delivering the raw counts; returns as readsensor_fn
+typedef int8_t(*readraw_fn)(int file, uint32_t * t, uint32_t * h);
+
+// A driver is split in a one-time set-up (configuration, calibration)
+// and a conversion, so that several conversions can share one session.
+// Conversions deliver raw counts, turned into deg C / % by raw.c.
+// read_*() below are set-up + one converted conversion.
+// For the scheduler of continuous mode a conversion is split further:
+// trigger() starts it and returns how long to wait (ms), busy() (if
+// any) is polled every poll_ms after that, then fetch() reads it out.
+// sample_raw() is the same conversion, waiting in place.
+struct sensor_drv {
+	const char *name;
+	enum sensor_type type;
+	int addr;                   ///< default i2c address
+	uint16_t sample_gap_ms;     ///< min time between two conversions
+	int8_t (*setup)(int file);  ///< returns 0 on success, -1 on error
+	readraw_fn sample_raw;
+	int (*trigger)(int file);   ///< returns ms to wait, -1 on error
+	int8_t (*busy)(int file);
+	uint16_t poll_ms;
+	readraw_fn fetch;
+};
+
+static int8_t convert_raw(enum sensor_type type, int8_t res, uint32_t t, uint32_t h,
+			  float * temp, float * humi)
+{
+	if (res > 0 && (res & 0x01))
+		*temp = raw_temp(type, t);
+	if (res > 0 && (res & 0x02))
+		*humi = raw_humi(type, h);
+	return res;
+}
+
+int8_t setup_mcp9801(int file)
 {
 	int res;
 
-	res = i2c_smbus_read_byte_data(file, MCP9801_CFG_REG);
+	res = bus_read_byte_data(file, MCP9801_CFG_REG);
 	if (res < 0) {
 		fprintf(stderr, "Error: Config reg read failed\n");
 		return -1;
@@ -88,23 +157,55 @@ int8_t read_mcp9801(int file, float * temp, float * humi)
 #ifdef DEBUG
 		printf("Wrong config 0x%02x. Setting it to 0x%02x\n", res, MCP9801_CFG_VALUE);
 #endif
-		i2c_smbus_write_byte_data(file, MCP9801_CFG_REG, MCP9801_CFG_VALUE);
+		bus_write_byte_data(file, MCP9801_CFG_REG, MCP9801_CFG_VALUE);
 		// the chip needs some time before larger-resolution conversion
-		usleep(MCP9801_CONV_TOUT_MS*1000);
+		bus_usleep(file, MCP9801_CONV_TOUT_MS*1000);
 	}
-	res = i2c_smbus_read_word_data(file, MCP9801_TEMPER_REG);
+	return 0;
+}
+
+int8_t sample_raw_mcp9801(int file, uint32_t * t, uint32_t * h)
+{
+	int res;
+
+	res = bus_read_word_data(file, MCP9801_TEMPER_REG);
 
 	if (res < 0) {
 		fprintf(stderr, "Error: Temperature reg read failed\n");
 		return -1;
 	}
 
-	*temp = (res&0xff)+(double)(res>>12)/16;
+	// SMBus words are little endian, the register is big endian;
+	// 12 bit resolution, so the low nibble is not part of the count
+	*t = (res&0xff)<<8 | ((res>>8)&0xf0);
+	*h = 0;
 	return 1;
 }
 
+// converts continuously, the register always holds the last result
+static int trigger_mcp9801(int file)
+{
+	(void)file;
+	return 0;
+}
+
+int8_t sample_mcp9801(int file, float * temp, float * humi)
+{
+	uint32_t t, h;
+	int8_t res = sample_raw_mcp9801(file, &t, &h);
+
+	return convert_raw(SENSOR_MCP9801, res, t, h, temp, humi);
+}
+
+int8_t read_mcp9801(int file, float * temp, float * humi)
+{
+	if (setup_mcp9801(file) < 0)
+		return -1;
+	return sample_mcp9801(file, temp, humi);
+}
+
 static uint8_t getStatus(int file) {
-  int8_t ret = i2c_smbus_read_byte(file);
+  int8_t ret = bus_read_byte(file);
 #if defined(DEBUG_GET_STATUS)  
   printf("status:0x%02x ", ret & 0xff);
 #endif
@@ -116,28 +217,35 @@ static uint8_t getStatus(int file) {
 
 static int busy_wait_limited(int file, uint8_t loop_delay_ms, uint8_t max_retries) {
   uint8_t retries = 0;
+  uint64_t t_wait = lat_now(), t_poll = t_wait;
   while (getStatus(file) & AHTX0_STATUS_BUSY) {
-	usleep(loop_delay_ms * 1000);
+	bus_record(file, LAT_POLL, t_poll);
+	lat_poll_signal();
+	bus_usleep(file, loop_delay_ms * 1000);
 #if defined(DEBUG)		
 		printf("Busy wait...%d\n", retries);
 #endif
 	retries++;
 	if (retries > max_retries) {
+	  bus_wait_done(file, retries, -1, t_wait);
 	  return -1;
 	}
+	t_poll = lat_now();
   }
+  bus_record(file, LAT_POLL, t_poll);
+  bus_wait_done(file, retries, 0, t_wait);
   return 0;
 }
 
-int8_t read_aht10(int file, float * temp, float * humi)
+int8_t setup_aht10(int file)
 {
 
 #if defined(AHT10_SOFTRESET)
-	if (i2c_smbus_write_byte(file, AHTX0_CMD_SOFTRESET) < 0) {
+	if (bus_write_byte(file, AHTX0_CMD_SOFTRESET) < 0) {
 		fprintf(stderr, "Error: reset failed\n");
 		return -1;
 	}
-	usleep(TOUT_20_MS*1000);
+	bus_usleep(file, TOUT_20_MS*1000);
 
 	if (busy_wait_limited(file, TOUT_10_MS, BUSY_WAIT_RETRIES) < 0) {
 		fprintf(stderr, "Error: reset busy timeout\n");
@@ -146,7 +254,7 @@ int8_t read_aht10(int file, float * temp, float * humi)
 #endif	
 
 	uint8_t data_cal[2] = {0x08, 0x00};
-	if (i2c_smbus_write_i2c_block_data(file, AHTX0_CMD_CALIBRATE, 2, data_cal) < 0) {
+	if (bus_write_i2c_block_data(file, AHTX0_CMD_CALIBRATE, 2, data_cal) < 0) {
 #if defined(AHT10_CALIBRATE_EXIT_ON_FAIL)
 		fprintf(stderr, "Error: send calibrate cmd failed\n");
 		return -1;
@@ -162,60 +270,152 @@ int8_t read_aht10(int file, float * temp, float * humi)
 		fprintf(stderr, "Error: calibration failed\n");
 		return -1;
 	}	
+	return 0;
+}
 
+static int trigger_aht10(int file)
+{
 	uint8_t data_trig[2] = {0x33, 0x00};
-	if (i2c_smbus_write_i2c_block_data(file, AHTX0_CMD_TRIGGER, 2, data_trig) < 0) {
+	if (bus_write_i2c_block_data(file, AHTX0_CMD_TRIGGER, 2, data_trig) < 0) {
 		fprintf(stderr, "Error: send trigger cmd failed\n");
 		return -1;
 	}
+	// typ. 75 ms, the scheduler polls busy() after that
+	return TOUT_80_MS;
+}
 
-	if(busy_wait_limited(file, TOUT_20_MS, BUSY_WAIT_RETRIES) < 0) {
-		fprintf(stderr, "Error: trigger busy timeout\n");
-		return -1;
-	}
+static int8_t busy_aht10(int file)
+{
+	return (getStatus(file) & AHTX0_STATUS_BUSY) != 0;
+}
 
+static int8_t fetch_aht10(int file, uint32_t * t, uint32_t * h)
+{
 	uint8_t data[6] = {0};
 
-   	if (i2c_smbus_read_i2c_block_data(file, 0x00, 6, data) < 0) {
+   	if (bus_read_i2c_block_data(file, 0x00, 6, data) < 0) {
 	 	fprintf(stderr, "Error: reading values failed\n");
 	 	return -1;
 	}
-	uint32_t h = data[1];
-	h <<= 8;
-	h |= data[2];
-	h <<= 4;
-	h |= data[3] >> 4;
-	*humi = ((float)h * 100) / 0x100000;
-
-	uint32_t tdata = data[3] & 0x0F;
-	tdata <<= 8;
-	tdata |= data[4];
-	tdata <<= 8;
-	tdata |= data[5];
-	*temp = ((float)tdata * 200 / 0x100000) - 50;	
+	decode_aht10(data, t, h);
 	return 3;
 }
 
-int8_t read_sht30(int file, float * temp, float * humi)
+int8_t sample_raw_aht10(int file, uint32_t * t, uint32_t * h)
 {
-	if (i2c_smbus_write_byte_data(file, SHT30_CMD_MEAS_HREP_MSB, SHT30_CMD_MEAS_HREP_LSB) < 0) {
-		fprintf(stderr, "Error: send measure cmd failed\n");
+	if (trigger_aht10(file) < 0)
+		return -1;
+
+	if(busy_wait_limited(file, TOUT_20_MS, BUSY_WAIT_RETRIES) < 0) {
+		fprintf(stderr, "Error: trigger busy timeout\n");
 		return -1;
 	}
 
-	usleep(TOUT_20_MS * 1000);
+	return fetch_aht10(file, t, h);
+}
+
+int8_t sample_aht10(int file, float * temp, float * humi)
+{
+	uint32_t t, h;
+	int8_t res = sample_raw_aht10(file, &t, &h);
+
+	return convert_raw(SENSOR_AHT10, res, t, h, temp, humi);
+}
 
+int8_t read_aht10(int file, float * temp, float * humi)
+{
+	if (setup_aht10(file) < 0)
+		return -1;
+	return sample_aht10(file, temp, humi);
+}
+
+int8_t setup_sht30(int file)
+{
+	// single shot mode, nothing to set up
+	(void)file;
+	return 0;
+}
+
+// Lower repeatability converts faster and heats the sensor less, at the
+// cost of noise - which a filter stage (--filter) can take out again
+static const struct {
+	const char *name;
+	uint8_t cmd_lsb;
+	uint8_t conv_ms;
+} sht30_rep[] = {
+	{ "high",   SHT30_CMD_MEAS_HREP_LSB, SHT30_HREP_MS },
+	{ "medium", SHT30_CMD_MEAS_MREP_LSB, SHT30_MREP_MS },
+	{ "low",    SHT30_CMD_MEAS_LREP_LSB, SHT30_LREP_MS },
+};
+static int sht30_rep_sel;   // index in sht30_rep, high by default
+
+static int trigger_sht30(int file)
+{
+	if (bus_write_byte_data(file, SHT30_CMD_MEAS_HREP_MSB, sht30_rep[sht30_rep_sel].cmd_lsb) < 0) {
+		fprintf(stderr, "Error: send measure cmd failed\n");
+		return -1;
+	}
+	return sht30_rep[sht30_rep_sel].conv_ms;
+}
+
+static int8_t fetch_sht30(int file, uint32_t * t, uint32_t * h)
+{
 	uint8_t data[6] = {0};
 
-   	if (i2c_smbus_read_i2c_block_data(file, 0x00, 6, data) < 0) {
+   	if (bus_read_i2c_block_data(file, 0x00, 6, data) < 0) {
 	 	fprintf(stderr, "Error: reading values failed\n");
 	 	return -1;
 	}
-	*temp = -45 + (175 * (float)(data[0] * 256 + data[1]) / 65535.0);
-	*humi = 100 * (float)(data[3] * 256 + data[4]) / 65535.0;
+	decode_sht30(data, t, h);
 	return 3;
 }
 
+int8_t sample_raw_sht30(int file, uint32_t * t, uint32_t * h)
+{
+	int ms = trigger_sht30(file);
+
+	if (ms < 0)
+		return -1;
+	bus_usleep(file, ms * 1000);
+	return fetch_sht30(file, t, h);
+}
+
+int8_t sample_sht30(int file, float * temp, float * humi)
+{
+	uint32_t t, h;
+	int8_t res = sample_raw_sht30(file, &t, &h);
+
+	return convert_raw(SENSOR_SHT30, res, t, h, temp, humi);
+}
+
+int8_t read_sht30(int file, float * temp, float * humi)
+{
+	return sample_sht30(file, temp, humi);
+}
+
+// the MCP9801 converts continuously; reading faster than one 12-bit
+// conversion would just return the same value again
+static const struct sensor_drv drv_mcp9801 = {
+	"MCP9801", SENSOR_MCP9801, MCP9801_ADDR, MCP9801_CONV_TOUT_MS,
+	setup_mcp9801, sample_raw_mcp9801,
+	trigger_mcp9801, NULL, 0, sample_raw_mcp9801
+};
+static const struct sensor_drv drv_aht10 = {
+	"AHT10", SENSOR_AHT10, AHTX0_ADDR_DEFAULT, 0, setup_aht10, sample_raw_aht10,
+	trigger_aht10, busy_aht10, TOUT_20_MS, fetch_aht10
+};
+static const struct sensor_drv drv_sht30 = {
+	"SHT30", SENSOR_SHT30, SHT30_ADDR_DEFAULT, 0, setup_sht30, sample_raw_sht30,
+	trigger_sht30, NULL, 0, fetch_sht30
+};
+
+// by sensor type, for the raw log
+static const struct sensor_drv *drivers[SENSOR_TYPES] = {
+	[SENSOR_MCP9801] = &drv_mcp9801,
+	[SENSOR_AHT10]   = &drv_aht10,
+	[SENSOR_SHT30]   = &drv_sht30,
+};
+
 static void help(void)
 {
 	fprintf(stderr,
@@ -228,7 +428,106 @@ static void help(void)
 		"  -3   Use SHT30 sensor\n"
 		"  -b   Bare format, temperature only (if not supported, considered as -r)\n"
 		"  -r   Bare format, humidity only (if not supported, considered as -b)\n"
+		"  -n N Take N conversions in one session and report their mean after\n"
+		"       rejecting outliers (3 sigma, estimated from the median deviation)\n"
+		"  --median  With -n, report the median instead of the mean\n"
+		"  --derived  Also report dew point, absolute humidity, humidex, heat\n"
+		"          index and vapour pressure deficit (sensors with humidity;\n"
+		"          not with -b/-r)\n"
+		"  -i SEC  Read continuously, every SEC seconds (fractions allowed)\n"
+		"  -c N    With -i, stop after N readings (default: until SIGINT/SIGTERM)\n"
+		"  -w SEC[,SEC..]  With -i, also report mean, sd, min/max and p5/p50/p95\n"
+		"          over windows of SEC seconds, aligned to the clock (e.g. 60,900,3600);\n"
+		"          in bare format as: period mean sd min max p5 p50 p95 n\n"
+		"  --deadband T[,H]  With -i, print temperature/humidity only when it\n"
+		"          moved by more than T deg C / H %% since last printed (H defaults\n"
+		"          to T; 0 prints changes only); in bare format a value not\n"
+		"          printed shows as =\n"
+		"  --heartbeat SEC  With --deadband, print anyway after SEC seconds\n"
+		"  --filter F[,F]  Smooth temperature[,humidity] before output, F is\n"
+		"          ema:ALPHA (weight of a new reading) or kalman:Q:R (process\n"
+		"          noise per second, measurement noise, both as variances)\n"
+		"  --filter-state FILE  Keep the filter state in FILE across runs\n"
+		"  --format json|csv|influx  One line per sample with timestamp (ns),\n"
+		"          sensor id, address, temperature, humidity and status,\n"
+		"          instead of the text output (-b/-r)\n"
+		"  --queue N[:POLICY]  With -i, hand the output to a writer thread through\n"
+		"          a queue of N records, so a slow reader never delays sampling;\n"
+		"          when it is full: drop-oldest (default), drop-newest or rollup\n"
+		"          (average into the newest queued reading of the sensor)\n"
+		"  --flush-ms MS  With --queue, write at least every MS ms (default 1000)\n"
+		"  --rt-prio N  With -i, run the sampling thread SCHED_FIFO at priority N\n"
+		"          (1-99, needs root or CAP_SYS_NICE)\n"
+		"  --cpu N  With -i, pin the sampling thread to core N\n"
+		"  --mlock  With -i, lock all memory (no page faults while sampling)\n"
+		"  --jitter  With -i, report how late the readings and conversion\n"
+		"          steps ran against their schedule, on stderr at exit\n"
+		"  --alloc-check  With -i, count heap allocations once every sensor took\n"
+		"          two readings; report them and exit 3 if there were any\n"
+		"          (room_temp-check, make check-alloc)\n"
+		"  --rep high|medium|low  SHT30 repeatability (conversion 15/6/4 ms)\n"
+		"  --raw-log FILE  Append every conversion to FILE as raw counts\n"
+		"          (16 byte records, see raw.h)\n"
+		"  --convert FILE  Convert a raw log (- for stdin) to readings and exit\n"
+		"  --journal FILE  Append every reading (after filters, before the\n"
+		"          deadband) to the crash-safe journal FILE; a torn tail left by\n"
+		"          a crash is cut off when it is opened again\n"
+		"  --sync N[,MS]  Make the journal durable (fdatasync) every N readings\n"
+		"          or MS ms after the first unsynced one (default 64,1000);\n"
+		"          1 syncs every reading, N 0 leaves it to the page cache, MS 0\n"
+		"          syncs on the count alone\n"
+		"  --read-journal FILE  Print the readings of a journal and exit\n"
+		"  --store DIR  Like --journal, into segments in DIR: each preallocated,\n"
+		"          sealed at a size/age limit and rolled up in the background\n"
+		"  --seal MIB[,MIN]  Segment size and age limit (default 16,60)\n"
+		"  --rollup SEC  Compact sealed segments to a mean per sensor and SEC\n"
+		"          seconds (default 60; 0 keeps every reading)\n"
+		"  --read-store DIR  Print the readings of a store and exit\n"
+		"  --sqlite FILE  Insert every reading into the SQLite database FILE\n"
+		"          (WAL mode), a transaction per --sync N readings or MS ms\n"
+		"          (needs a build with make SQLITE=1)\n"
+		"  --last H  With --read-store, only the last H hours\n"
+		"  --export FILE  With --convert, --read-journal or --read-store, write\n"
+		"          the readings to FILE in columns (Arrow IPC / Feather v2: ts,\n"
+		"          sensor as a dictionary, temp, humi) instead of printing them\n"
+		"  --record FILE  Write every bus transaction to the transcript FILE\n"
+		"  --replay FILE  Take the bus transactions from a transcript instead of\n"
+		"          the sensor, at full speed; with -i it goes through all of its\n"
+		"          readings, or loops over them until -c N\n"
 		"  -h   Print this help\n"
+		"  --stats  Print bus/wait latency histograms to stderr before exit\n"
+		"           (a running instance also dumps them on SIGUSR1)\n"
+		"  --profile  Print where the wall time of this run went, from exec to exit\n"
+		"  --deg CODESET  Codeset for the degree sign (e.g. UTF-8, ISO-8859-1, ASCII),\n"
+		"           or \"iconv\" to ask the locale; default from $ROOM_TEMP_DEG,\n"
+		"           else LC_ALL/LC_CTYPE/LANG\n"
+		"  --show-deg  Print the degree sign that would be used and exit\n"
+		"  --fuse TYPE[@ADDR][:OFFSET[:WEIGHT]][,..]  Read these sensors (MCP9801,\n"
+		"          AHT10, SHT30, at the default or given address) together and\n"
+		"          report their weighted median temperature as sensor FUSED;\n"
+		"          OFFSET deg C is added to the sensor's readings (calibration),\n"
+		"          WEIGHT defaults to 1. A sensor off the median of all by more\n"
+		"          than --fuse-tol is left out, with status drift. Text output\n"
+		"          shows the fused reading only. Without -i, one reading\n"
+		"  --fuse-tol T  How far a fused sensor may be off the others, deg C\n"
+		"          (default 1)\n"
+		"  --check-fuse  Run step fault and slow drift scenarios through the\n"
+		"          fusion and exit, with 3 if one failed\n"
+		"  --check-store  Run short runs of different sensors into one store\n"
+		"          segment (scratch store in the current directory), check\n"
+		"          their rollups and exit, with 3 if they are mixed\n"
+		"  --simulate N[:TYPE[,TYPE..]]  Load generator: with -i, read N emulated\n"
+		"          sensors (MCP9801, AHT10, SHT30, round robin) instead of the\n"
+		"          real one, -c N readings each, and report readings/s, CPU per\n"
+		"          reading and memory per sensor\n"
+		"  --bench-decode N  Measure the frame decoders over N frames and exit\n"
+		"  --bench-output N  Measure the output formatter over N records and exit\n"
+		"  --bench-derived N  Measure the --derived quantities over N readings\n"
+		"          against libm, and their largest errors, and exit\n"
+		"  --bench-journal N  Measure N journal appends under a few sync policies\n"
+		"          (scratch file in the current directory) and exit\n"
+		"  --bench-sqlite N  Measure N SQLite inserts, a transaction per row and\n"
+		"          per batch (scratch database in the current directory), and exit\n"
 		"Options -2 and -3 are mutually exclusive\n"
 		"If both are given, the last one is used\n");
 	exit(1);
@@ -262,34 +561,1632 @@ void set_degstr(void)
 	strcpy(degstr, deg_default_text);
 }
 
+/* Degree sign for the common codesets, so that the usual case needs
+   neither setlocale() nor iconv (which loads the gconv configuration
+   and modules). Names are compared ignoring case, '-' and '_'. */
+static const struct {
+	const char *codeset;
+	const char *text;
+} deg_table[] = {
+	{ "UTF-8",          "\302\260C" },
+	{ "ISO-8859-1",     "\260C" },
+	{ "ISO8859-1",      "\260C" },
+	{ "ISO-8859-15",    "\260C" },
+	{ "ISO8859-15",     "\260C" },
+	{ "LATIN1",         "\260C" },
+	{ "ANSI_X3.4-1968", "'C" },
+	{ "ASCII",          "'C" },
+	{ "US-ASCII",       "'C" },
+};
+
+static int codeset_eq(const char *a, const char *b, size_t blen)
+{
+	const char *bend = b + blen;
+
+	for (;;) {
+		while (*a == '-' || *a == '_')
+			a++;
+		while (b < bend && (*b == '-' || *b == '_'))
+			b++;
+		if (!*a || b == bend)
+			return !*a && b == bend;
+		if ((*a | 0x20) != (*b | 0x20))
+			return 0;
+		a++;
+		b++;
+	}
+}
+
+/* Set degstr from the table, for the codeset given as name (e.g. via
+   --deg) or else taken from LC_ALL/LC_CTYPE/LANG the way setlocale()
+   would resolve it. Returns -1 if the slow path via iconv is needed. */
+int set_degstr_fast(const char *name)
+{
+	const char *loc, *cs;
+	size_t len, i;
+
+	if (name) {
+		if (!strcmp(name, "iconv"))
+			return -1;
+		cs = name;
+		len = strlen(name);
+	} else {
+		if (!(loc = getenv("LC_ALL")) || !*loc)
+			if (!(loc = getenv("LC_CTYPE")) || !*loc)
+				loc = getenv("LANG");
+		if (!loc || !*loc || !strcmp(loc, "C") || !strcmp(loc, "POSIX")) {
+			cs = "ASCII";
+			len = 5;
+		} else {
+			/* language[_territory][.codeset][@modifier] */
+			if (!(cs = strchr(loc, '.')))
+				return -1;
+			cs++;
+			len = strcspn(cs, "@");
+		}
+	}
+
+	for (i = 0; i < sizeof(deg_table) / sizeof(deg_table[0]); i++) {
+		if (codeset_eq(deg_table[i].codeset, cs, len)) {
+			strcpy(degstr, deg_table[i].text);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+void init_degstr(const char *name)
+{
+	if (set_degstr_fast(name) < 0) {
+		setlocale(LC_CTYPE, "");
+		prof_mark(PROF_LOCALE);
+		set_degstr();
+	}
+	prof_mark(PROF_DEGSTR);
+}
+
+/* argument of an option, attached (-n8) or as the next word (-n 8);
+   exits with the usage text if missing */
+static const char *opt_arg(int argc, char *argv[], int *flags)
+{
+	const char *opt = argv[1+*flags];
+
+	if (opt[1] != '-' && opt[2])
+		return &opt[2];
+	if (2+*flags >= argc) {
+		fprintf(stderr, "Error: Option \"%s\" needs an argument!\n", opt);
+		help();
+	}
+	(*flags)++;
+	return argv[1+*flags];
+}
+
+/* settings of a run, filled in from the command line */
+static struct {
+	const struct sensor_drv *drv;
+	int nsamples;               ///< conversions per reading (-n)
+	uint8_t use_median;
+	uint8_t derived;            ///< dew point, humidex, .. (--derived)
+	uint8_t bare_fmt;
+	uint8_t format;             ///< enum out_format
+	uint32_t queue_cap;         ///< output queue records, 0: write inline
+	uint8_t queue_policy;       ///< enum outq_policy
+	uint32_t flush_ms;          ///< output queue flush interval
+	struct rt_cfg rt;           ///< sampling thread priority, core, mlock
+	uint8_t jitter;             ///< report scheduled vs actual step times
+	uint8_t alloc_check;        ///< count heap allocations after warm-up
+	const char *journal;        ///< journal file, NULL: none
+	uint32_t sync_n;            ///< journal group commit: readings
+	uint32_t sync_ms;           ///< and time
+	const char *store;          ///< segment directory, NULL: none
+	uint64_t seal_bytes;        ///< segment size limit
+	uint32_t seal_s;            ///< segment age limit
+	uint32_t rollup_s;          ///< compaction buckets
+	const char *sqlite;         ///< SQLite database, NULL: none
+	uint8_t print_stats;
+	uint64_t interval_ns;       ///< 0: single reading
+	uint32_t count;             ///< readings in continuous mode, 0: forever
+	int nwindows;
+	uint32_t window_s[MAX_WINDOWS];
+	struct deadband deadband;
+	struct filter_cfg filter[2];    ///< temp, humi
+	const char *filter_state;       ///< file keeping the filter state
+	uint32_t sim_n;                 ///< emulated sensors (--simulate)
+	int sim_ntypes;
+	enum sensor_type sim_types[SENSOR_TYPES];
+	uint32_t nfuse;                 ///< sensors fused (--fuse)
+	struct {
+		const struct sensor_drv *drv;
+		int addr;
+		float offset, weight;
+	} fuse[FUSE_MAX];
+	float fuse_tol;                 ///< deg C
+} cfg = {
+	.flush_ms = 1000,
+	.sync_n = 64,
+	.sync_ms = 1000,
+	.seal_bytes = 16 << 20,
+	.seal_s = 3600,
+	.rollup_s = 60,
+	.fuse_tol = 1.0f,
+	.rt = { .cpu = -1 },
+	.drv = &drv_mcp9801,
+	.nsamples = 1,
+};
+
+static volatile sig_atomic_t stop_req;
+static FILE *raw_log;       ///< every conversion as raw counts (--raw-log)
+static struct journal journal;  ///< every reading (--journal)
+static int journal_on;
+static int store_on;        ///< --store
+static int db_on;           ///< --sqlite
+static int sink_on;         ///< any of them
+
+static void on_stop(int sig)
+{
+	(void)sig;
+	stop_req = 1;
+}
+
+static uint64_t realtime_ns(void)
+{
+	struct timespec ts;
+
+	if (trace_mode == TRACE_REPLAY)
+		return trace_time();
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static int io_on;                   ///< continuous mode: sampling/I/O threads
+static void io_push_raw(const struct raw_rec *rec);
+
+/* one conversion into the reading under way: raw log, deg C / % */
+static void add_conversion(const struct sensor_drv *drv, struct sample *s,
+			   int8_t r, uint64_t ts, float *temp, float *humi)
+{
+	struct raw_rec rec;
+
+	if (raw_log) {
+		raw_pack(&rec, ts, s->addr, drv->type, r, s->raw_t, s->raw_h);
+		if (io_on)
+			io_push_raw(&rec);
+		else
+			raw_log_write(raw_log, &rec);
+	}
+	convert_raw(drv->type, r, s->raw_t, s->raw_h, temp, humi);
+}
+
+/* the ok conversions of a reading reduced to one value (outliers
+   rejected); res is the status of the last good one */
+static int8_t reduce_reading(struct sample *s, float *temps, float *humis,
+			     int ok, int8_t res)
+{
+	struct robust rt, rh;
+
+	s->nok = ok;
+	s->status = ok ? res : -1;
+	s->mask = ok ? res : 0;
+
+	robust_reduce(temps, ok, &rt);
+	robust_reduce(humis, ok, &rh);
+	s->temp = cfg.use_median ? rt.median : rt.mean;
+	s->humi = cfg.use_median ? rh.median : rh.mean;
+	s->temp_sd = rt.sd;
+	s->humi_sd = rh.sd;
+	return s->status;
+}
+
+/* One reading: cfg.nsamples back-to-back conversions reduced to one
+   value. The driver must be set up already. Returns the sample status. */
+static int8_t take_reading(int file, struct sample *s)
+{
+	static float temps[OVERSAMPLE_MAX], humis[OVERSAMPLE_MAX];
+	const struct sensor_drv *drv = cfg.drv;
+	int i, ok = 0;
+	int8_t res = -1;
+	uint64_t t0;
+
+	trace_mark(drv->addr);
+	s->ts = realtime_ns();
+	s->sensor = drv->name;
+	s->addr = drv->addr;
+	s->type = drv->type;
+	s->id = 0;
+	s->nconv = cfg.nsamples;
+	for (i = 0; i < cfg.nsamples; i++) {
+		int8_t r;
+
+		if (i > 0 && drv->sample_gap_ms)
+			bus_usleep(file, drv->sample_gap_ms * 1000);
+		t0 = lat_now();
+		r = drv->sample_raw(file, &s->raw_t, &s->raw_h);
+		bus_sample_done(file, r, t0);
+		if (r > 0) {
+			add_conversion(drv, s, r, i ? realtime_ns() : s->ts,
+				       &temps[ok], &humis[ok]);
+			res = r;
+			ok++;
+		}
+		lat_poll_signal();
+	}
+	return reduce_reading(s, temps, humis, ok, res);
+}
+
+/* the sinks a reading is kept in: journal, store, SQLite */
+static void sink_sample(const struct sample *s)
+{
+	struct jrec r = {
+		.ts = s->ts, .id = s->id, .addr = s->addr, .type = s->type,
+		.status = s->status, .flags = s->flags, .temp = s->temp,
+		.humi = s->humi,
+	};
+
+	if (journal_on)
+		journal_append(&journal, &r);
+	if (store_on)
+		store_append(&r);
+	if (db_on)
+		db_append(&r);
+}
+
+// their group commits
+static void sink_commit(uint64_t now)
+{
+	if (journal_on)
+		journal_commit(&journal, now);
+	if (store_on)
+		store_commit(now);
+	if (db_on)
+		db_commit(now);
+}
+
+static uint64_t sink_due(uint64_t a, uint64_t b)
+{
+	return a && (!b || a < b) ? a : b;
+}
+
+static uint64_t sink_sync_due(void)
+{
+	uint64_t due = journal_on ? journal_sync_due(&journal) : 0;
+
+	due = sink_due(due, store_on ? store_sync_due() : 0);
+	return sink_due(due, db_on ? db_commit_due() : 0);
+}
+
+static void sink_close(void)
+{
+	if (journal_on)
+		journal_close(&journal);
+	if (store_on)
+		store_close();
+	if (db_on)
+		db_close();
+}
+
+/* the quantities derived from a reading with both temperature and
+   humidity, after the filters */
+static void add_derived(struct sample *s)
+{
+	s->derived = cfg.derived && s->status > 0 && (s->status & 0x03) == 0x03;
+	if (s->derived)
+		psychro(s->temp, s->humi, &s->dp);
+}
+
+static struct filter_state filter_st[2];
+
+/* the filter stage, between conversion and output */
+static void apply_filters(struct sample *s, struct filter_state st[2])
+{
+	if (s->status <= 0)
+		return;
+	if (s->status & 0x01)
+		s->temp = filter_apply(&cfg.filter[0], &st[0], s->temp, s->ts);
+	if (s->status & 0x02)
+		s->humi = filter_apply(&cfg.filter[1], &st[1], s->humi, s->ts);
+}
+
+/* Continuous mode: every sensor takes a reading every cfg.interval_ns
+   on its own absolute schedule. Sensors are stepped from one timer
+   queue, so the conversions of many sensors overlap: a sensor waiting
+   for its conversion costs nothing until it is due again. */
+
+enum sensor_state {
+	SENS_IDLE = 0,          ///< next: start a reading
+	SENS_GAP,               ///< next: start the next conversion of a reading
+	SENS_CONV,              ///< next: poll/fetch the conversion under way
+};
+
+struct sensor {
+	const struct sensor_drv *drv;
+	int file;
+	uint8_t state;          ///< enum sensor_state
+	uint8_t polls;
+	uint16_t conv;          ///< conversions of the current reading done
+	uint16_t ok;
+	int8_t res;
+	uint32_t readings;
+	uint64_t slot;          ///< start of the current reading (monotonic)
+	uint64_t t0;            ///< start of the current conversion
+	struct sample s;
+	float *temps, *humis;   ///< cfg.nsamples conversions each
+	struct filter_state filt[2];
+	struct deadband_state db;
+	struct window *win;     ///< cfg.nwindows
+};
+
+static struct sensor *sensors;     ///< in the arena, like all their state
+static uint32_t nsensors, sensors_cap;
+static uint32_t good_readings;
+static struct lat_hist sched_lag;   ///< how late readings start
+static struct lat_hist step_lag;    ///< how late any step (trigger, poll, fetch) runs
+static uint64_t replay_clock;       ///< monotonic time of a replay
+
+static uint64_t mono_now(void)
+{
+	return trace_mode == TRACE_REPLAY ? replay_clock : lat_now();
+}
+
+// the sensor ids of a run: one real sensor, --fuse (then FUSED) or
+// --simulate N
+static uint32_t sensor_ids(void)
+{
+	return cfg.sim_n ? cfg.sim_n : cfg.nfuse ? cfg.nfuse + 1 : 1;
+}
+
+static struct sensor *add_sensor(const struct sensor_drv *drv, int file)
+{
+	struct sensor *se;
+	int w;
+
+	// one real sensor, --fuse or --simulate N
+	if (!sensors) {
+		sensors_cap = cfg.sim_n ? cfg.sim_n : cfg.nfuse ? cfg.nfuse : 1;
+		sensors = arena_alloc(sensors_cap * sizeof(*sensors));
+	}
+	if (!sensors || nsensors == sensors_cap)
+		return NULL;
+	se = &sensors[nsensors];
+	se->drv = drv;
+	se->file = file;
+	se->s.sensor = drv->name;
+	se->s.addr = drv->addr;
+	se->s.type = drv->type;
+	se->s.id = nsensors;
+	se->s.nconv = cfg.nsamples;
+	se->temps = arena_alloc(2 * cfg.nsamples * sizeof(float));
+	se->win = cfg.nwindows ? arena_alloc(cfg.nwindows * sizeof(*se->win)) : NULL;
+	if (!se->temps || (cfg.nwindows && !se->win))
+		return NULL;
+	se->humis = se->temps + cfg.nsamples;
+	for (w = 0; w < cfg.nwindows; w++)
+		se->win[w].period = cfg.window_s[w];
+	nsensors++;
+	return se;
+}
+
+/* deadband, output and windows of a reading */
+static void emit_sample(struct sample *s, struct deadband_state *db, struct window *win)
+{
+	uint64_t now_s = s->ts / 1000000000u;
+	int w;
+
+	s->mask = deadband_mask(&cfg.deadband, db, s);
+	out_sample(s);
+
+	for (w = 0; w < cfg.nwindows; w++) {
+		if (window_due(&win[w], now_s)) {
+			if (win[w].caps)
+				out_window(s->sensor, s->addr, &win[w]);
+			window_reset(&win[w], now_s);
+		}
+		if (s->status > 0)
+			window_add(&win[w], s->status, s->temp, s->humi);
+	}
+}
+
+/* Fusion (--fuse): the readings of the sensors that belong to one
+   schedule slot are combined once all of them are in, or once a reading
+   of a later slot turns up (a sensor that overran its slot is left out
+   of that one). The fused reading is a sensor of its own, FUSED, with
+   the index after the real ones. The readings of the sensors wait for
+   it, so that they go out flagged by the cycle they took part in. */
+
+static int fuse_on;
+static struct fusion fusion;
+static uint64_t fuse_slot;          ///< slot being gathered
+static uint64_t fuse_ts;            ///< its first reading
+static int fuse_got;                ///< readings of it in
+static struct sample fuse_s[FUSE_MAX];  ///< of its sensors, by index
+static uint8_t fuse_in[FUSE_MAX];   ///< fuse_s[] holds one of this slot
+static struct deadband_state fuse_db;
+static struct window *fuse_win;     ///< cfg.nwindows, in the arena
+
+static void fuse_report(void)
+{
+	static uint8_t disagreed;
+	int i;
+
+	for (i = 0; i < fusion.n; i++) {
+		const struct fuse_member *m = &fusion.m[i];
+
+		if (!m->changed)
+			continue;
+		if (m->drift)
+			fprintf(stderr, "Warning: %s at 0x%02x is %+.2f deg C off the "
+				"median, left out of the fusion\n", sensors[i].s.sensor,
+				sensors[i].s.addr, m->dev);
+		else
+			fprintf(stderr, "Warning: %s at 0x%02x agrees with the others "
+				"again\n", sensors[i].s.sensor, sensors[i].s.addr);
+	}
+	if (fusion.disagree != disagreed)
+		fprintf(stderr, fusion.disagree ?
+			"Warning: the fused sensors are more than %.2f deg C apart\n" :
+			"Warning: the fused sensors are within %.2f deg C again\n",
+			fusion.tol);
+	disagreed = fusion.disagree;
+}
+
+// the reading of sensor i, flagged with its drift as it stands
+static void fuse_member_emit(uint32_t i, struct sample *s)
+{
+	s->flags = fusion.m[i].drift ? SAMPLE_DRIFT : 0;
+	if (sink_on)
+		sink_sample(s);
+	// text output is the fused reading alone
+	if (cfg.format != OUT_TEXT)
+		emit_sample(s, &sensors[i].db, sensors[i].win);
+}
+
+static void fuse_emit(void)
+{
+	struct sample s = {
+		.ts = fuse_ts, .sensor = "FUSED", .type = SENSOR_NONE,
+		.id = nsensors, .nconv = fusion.n,
+	};
+	int used = fuse_cycle(&fusion, &s.temp, &s.temp_sd);
+	int i;
+
+	fuse_report();
+	fuse_got = 0;
+	for (i = 0; i < fusion.n; i++)
+		if (fuse_in[i]) {
+			fuse_member_emit(i, &fuse_s[i]);
+			fuse_in[i] = 0;
+		}
+	s.nok = used;
+	s.status = used ? 0x01 : -1;
+	s.mask = used ? 0x01 : 0;
+	s.flags = SAMPLE_FUSED | (fusion.disagree ? SAMPLE_DISAGREE : 0);
+	if (sink_on)
+		sink_sample(&s);
+	emit_sample(&s, &fuse_db, fuse_win);
+}
+
+static void fuse_add(uint32_t i, uint64_t slot, struct sample *s)
+{
+	struct fuse_member *m = &fusion.m[i];
+
+	if (fuse_got && slot != fuse_slot) {
+		// its slot is gone
+		if (slot < fuse_slot) {
+			fuse_member_emit(i, s);
+			return;
+		}
+		fuse_emit();
+	}
+	if (!fuse_got) {
+		fuse_slot = slot;
+		fuse_ts = s->ts;
+	}
+	m->have = s->status > 0 && (s->status & 0x01);
+	m->temp = s->temp;
+	fuse_s[i] = *s;
+	fuse_in[i] = 1;
+	if (++fuse_got == fusion.n)
+		fuse_emit();
+}
+
+/* filters, deadband, output and windows of a finished reading, on the
+   I/O thread; s is its copy of se->s */
+static void emit_reading(struct sensor *se, struct sample *s, uint64_t slot)
+{
+	uint32_t i = se - sensors;
+
+	// calibration first, so that the filters see calibrated readings
+	if (fuse_on && s->status > 0 && (s->status & 0x01))
+		s->temp += fusion.m[i].offset;
+	apply_filters(s, se->filt);
+	add_derived(s);
+	if (fuse_on) {
+		fuse_add(i, slot, s);
+		return;
+	}
+	if (sink_on)
+		sink_sample(s);
+	emit_sample(s, &se->db, se->win);
+}
+
+/* The sampling thread (the scheduler) only touches the bus. Finished
+   readings and raw conversions go to the I/O thread through a lock-free
+   SPSC ring of fixed-size records; it does the filters, deadband,
+   windows, output and raw log, so a stalled pipe or a slow disk never
+   delays a conversion. The sampling thread does not allocate, lock or
+   write: it wakes the I/O thread (sem_post) when it is about to sleep,
+   or when a quarter of the ring has filled up. If the ring is full,
+   records are dropped and counted; only a replay, which has no clock
+   to keep, waits for room instead, so that it stays reproducible. */
+
+#define IO_RING_MIN         1024
+
+enum io_kind {
+	IO_READING,
+	IO_RAW,
+};
+
+struct io_rec {
+	uint8_t kind;           ///< enum io_kind
+	uint32_t sensor;        ///< index, for IO_READING
+	uint64_t slot;          ///< its schedule slot, for IO_READING
+	union {
+		struct sample s;
+		struct raw_rec raw;
+	} u;
+};
+
+static struct spsc io_ring;
+static sem_t io_wake;
+static atomic_int io_done;
+static pthread_t io_thread;
+static uint32_t io_pending, io_kick_at;     // sampling thread only
+static uint32_t io_dropped;
+static int io_warm;                         ///< warm-up over (--alloc-check)
+static unsigned long io_allocs;             ///< after warm-up
+
+static void io_kick(void)
+{
+	if (io_pending) {
+		io_pending = 0;
+		sem_post(&io_wake);
+	}
+}
+
+static struct io_rec *io_claim(void)
+{
+	struct io_rec *r = spsc_claim(&io_ring);
+
+	while (!r && trace_mode == TRACE_REPLAY) {
+		io_pending = 1;
+		io_kick();
+		sched_yield();
+		r = spsc_claim(&io_ring);
+	}
+	if (!r)
+		io_dropped++;
+	return r;
+}
+
+static void io_publish(void)
+{
+	spsc_publish(&io_ring);
+	if (++io_pending >= io_kick_at)
+		io_kick();
+}
+
+static void io_push_raw(const struct raw_rec *rec)
+{
+	struct io_rec *r = io_claim();
+
+	if (r) {
+		r->kind = IO_RAW;
+		r->u.raw = *rec;
+		io_publish();
+	}
+}
+
+static void io_push_reading(const struct sensor *se)
+{
+	struct io_rec *r = io_claim();
+
+	if (r) {
+		r->kind = IO_READING;
+		r->sensor = se - sensors;
+		r->slot = se->slot;
+		r->u.s = se->s;
+		io_publish();
+	}
+}
+
+// waits for the sampling thread, or until the journal is due a sync
+static int io_wait(void)
+{
+	uint64_t due = sink_sync_due();
+	uint64_t now = lat_now();
+	struct timespec ts;
+
+	if (!due)
+		return sem_wait(&io_wake);
+	// sem_timedwait() takes CLOCK_REALTIME (not the replay clock)
+	clock_gettime(CLOCK_REALTIME, &ts);
+	due = (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec +
+		(due > now ? due - now : 0);
+	ts.tv_sec = due / 1000000000u;
+	ts.tv_nsec = due % 1000000000u;
+	if (sem_timedwait(&io_wake, &ts) == 0 || errno == ETIMEDOUT)
+		return 0;
+	return -1;
+}
+
+static void *io_main(void *arg)
+{
+	// warm-up: every sensor through two readings (buffers, first
+	// output, window set-up); the sampling thread is ahead of us
+	uint64_t warm = cfg.alloc_check ? 2ull * nsensors : 0, emitted = 0;
+
+	(void)arg;
+	rt_helper_thread();
+	for (;;) {
+		int done = atomic_load(&io_done);
+		struct io_rec *r;
+
+		while ((r = spsc_front(&io_ring))) {
+			if (r->kind == IO_RAW) {
+				raw_log_write(raw_log, &r->u.raw);
+			} else {
+				emit_reading(&sensors[r->sensor], &r->u.s, r->slot);
+				if (++emitted == warm) {
+					io_warm = 1;
+					alloc_guard_arm();
+				}
+			}
+			spsc_release(&io_ring);
+		}
+		out_flush();
+		if (raw_log)
+			fflush(raw_log);
+		if (sink_on)
+			sink_commit(lat_now());
+		lat_poll_signal();
+		if (done) {
+			if (fuse_got) {
+				fuse_emit();
+				out_flush();
+			}
+			break;
+		}
+		// SIGUSR1 comes here (see io_start) and interrupts the wait
+		while (io_wait() < 0 && errno == EINTR)
+			lat_poll_signal();
+	}
+	return NULL;
+}
+
+// SIGINT/SIGTERM stay with the sampling thread, which polls stop_req,
+// SIGUSR1 (histogram dump) goes to the I/O thread
+static int io_start(void)
+{
+	size_t n = IO_RING_MIN;
+	sigset_t set, usr1;
+
+	while (n < 2u * nsensors * (cfg.nsamples + 1))
+		n <<= 1;
+	if (spsc_init(&io_ring, n, sizeof(struct io_rec)) < 0) {
+		fprintf(stderr, "Error: out of memory\n");
+		return -1;
+	}
+	io_kick_at = n / 4;
+	sem_init(&io_wake, 0, 0);
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	sigemptyset(&usr1);
+	sigaddset(&usr1, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+	if (pthread_create(&io_thread, NULL, io_main, NULL)) {
+		fprintf(stderr, "Error: Could not start the I/O thread\n");
+		pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+		return -1;
+	}
+	pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+	pthread_sigmask(SIG_BLOCK, &usr1, NULL);
+	io_on = 1;
+	return 0;
+}
+
+// lets the I/O thread finish what is queued and waits for it
+static void io_stop(void)
+{
+	sigset_t usr1;
+
+	atomic_store(&io_done, 1);
+	sem_post(&io_wake);
+	pthread_join(io_thread, NULL);
+	io_allocs = alloc_guard_disarm();
+	io_on = 0;
+	sem_destroy(&io_wake);
+	sigemptyset(&usr1);
+	sigaddset(&usr1, SIGUSR1);
+	pthread_sigmask(SIG_UNBLOCK, &usr1, NULL);
+	if (io_dropped)
+		fprintf(stderr, "Error: I/O thread fell behind, %u records dropped\n",
+			io_dropped);
+}
+
+/* Advances a sensor by one step, returns when it is due next (monotonic
+   ns), 0 when it is done */
+static uint64_t sensor_step(struct sensor *se)
+{
+	const struct sensor_drv *drv = se->drv;
+	uint64_t now;
+	int8_t r = -1;
+	int ms;
+
+	switch (se->state) {
+	case SENS_IDLE:
+		// a replay loops over its readings until -c N, or else ends
+		// with them; a driver/transcript mismatch ends it right away
+		if (trace_mode == TRACE_REPLAY && se->readings > 0 && trace_replay_end()) {
+			if (trace_replay_end() < 0 || cfg.count == 0)
+				return 0;
+			trace_rewind();
+		}
+		lat_record(&sched_lag, mono_now() - se->slot);
+		trace_mark(se->s.addr);
+		se->s.ts = realtime_ns();
+		se->conv = se->ok = 0;
+		se->res = -1;
+		/* fall through */
+	case SENS_GAP:
+		se->t0 = lat_now();
+		ms = drv->trigger(se->file);
+		if (ms < 0)
+			break;
+		se->state = SENS_CONV;
+		se->polls = 0;
+		return mono_now() + ms * 1000000ull;
+	case SENS_CONV:
+		if (drv->busy && drv->busy(se->file)) {
+			if (++se->polls <= BUSY_WAIT_RETRIES)
+				return mono_now() + drv->poll_ms * 1000000ull;
+			fprintf(stderr, "Error: trigger busy timeout\n");
+			break;
+		}
+		r = drv->fetch(se->file, &se->s.raw_t, &se->s.raw_h);
+		break;
+	}
+
+	// the conversion is done
+	bus_sample_done(se->file, r, se->t0);
+	if (r > 0) {
+		add_conversion(drv, &se->s, r, se->conv ? realtime_ns() : se->s.ts,
+			       &se->temps[se->ok], &se->humis[se->ok]);
+		se->res = r;
+		se->ok++;
+	}
+	now = mono_now();
+	if (++se->conv < cfg.nsamples) {
+		se->state = SENS_GAP;
+		return now + drv->sample_gap_ms * 1000000ull;
+	}
+
+	if (reduce_reading(&se->s, se->temps, se->humis, se->ok, se->res) > 0)
+		good_readings++;
+	io_push_reading(se);
+	se->state = SENS_IDLE;
+	if (++se->readings == cfg.count)
+		return 0;
+
+	// next slot on the absolute schedule; after an overrun skip
+	// the missed slots instead of bursting to catch up
+	se->slot += cfg.interval_ns;
+	if (se->slot < now)
+		se->slot += (now - se->slot) / cfg.interval_ns * cfg.interval_ns +
+			cfg.interval_ns;
+	return se->slot;
+}
+
+static void jitter_line(FILE *f, const char *name, const struct lat_hist *h)
+{
+	fprintf(f, "  %-14s n=%u p50=%u p99=%u p99.9=%u max=%u\n", name, h->count,
+		lat_percentile(h, 50), lat_percentile(h, 99),
+		lat_percentile(h, 99.9), h->max_us);
+}
+
+/* actual - scheduled time of the readings and of every step, in us */
+static void jitter_report(FILE *f)
+{
+	rt_describe(f);
+	fprintf(f, "Jitter (actual - scheduled, us):\n");
+	jitter_line(f, "reading start", &sched_lag);
+	jitter_line(f, "any step", &step_lag);
+}
+
+/* Runs all sensors until each took cfg.count readings (or forever),
+   summarised over the configured windows. Returns the number of good
+   readings. */
+static uint32_t run_continuous(void)
+{
+	struct sigaction sa;
+	struct sched q;
+	uint64_t start;
+	uint32_t i;
+	int w;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_stop;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	if (sched_init(&q, nsensors) < 0) {
+		fprintf(stderr, "Error: out of memory\n");
+		return 0;
+	}
+	if (io_start() < 0)
+		return 0;
+	start = mono_now();
+	for (w = 0; fuse_on && w < cfg.nwindows; w++)
+		window_reset(&fuse_win[w], realtime_ns() / 1000000000u);
+	for (i = 0; i < nsensors; i++) {
+		for (w = 0; w < cfg.nwindows; w++)
+			window_reset(&sensors[i].win[w], realtime_ns() / 1000000000u);
+		sensors[i].slot = start;
+		sched_push(&q, start, i);
+	}
+
+	while (!stop_req && q.n) {
+		const struct sched_ev *next = sched_peek(&q);
+		struct sched_ev ev;
+		uint64_t due;
+
+		// nothing due: let the I/O thread push the output out, then
+		// wait (a replay just moves its clock on)
+		if (next->due > mono_now()) {
+			struct timespec ts = {
+				next->due / 1000000000u, next->due % 1000000000u
+			};
+
+			if (trace_mode == TRACE_REPLAY) {
+				replay_clock = next->due;
+				continue;
+			}
+			io_kick();
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+			continue;
+		}
+		ev = sched_pop(&q);
+		lat_record(&step_lag, mono_now() - ev.due);
+		due = sensor_step(&sensors[ev.id]);
+		if (due)
+			sched_push(&q, due, ev.id);
+	}
+	io_stop();
+	if (cfg.jitter)
+		jitter_report(stderr);
+	if (cfg.alloc_check) {
+		if (io_warm)
+			fprintf(stderr, "Heap allocations after warm-up: %lu\n", io_allocs);
+		else
+			fprintf(stderr, "Error: too few readings (-c) to get past warm-up\n");
+	}
+
+	// report the windows still open, n tells how much they cover
+	for (i = 0; i < nsensors; i++)
+		for (w = 0; w < cfg.nwindows; w++)
+			if (sensors[i].win[w].caps && (!fuse_on || cfg.format != OUT_TEXT))
+				out_window(sensors[i].s.sensor, sensors[i].s.addr,
+					   &sensors[i].win[w]);
+	for (w = 0; fuse_on && w < cfg.nwindows; w++)
+		if (fuse_win[w].caps)
+			out_window("FUSED", 0, &fuse_win[w]);
+	out_flush();
+	if (raw_log)
+		fflush(raw_log);
+	return good_readings;
+}
+
+/* resident set size in bytes, 0 if unknown */
+static uint64_t rss_bytes(void)
+{
+	FILE *f = fopen("/proc/self/statm", "r");
+	unsigned long size, res = 0;
+
+	if (f) {
+		if (fscanf(f, "%lu %lu", &size, &res) != 2)
+			res = 0;
+		fclose(f);
+	}
+	return (uint64_t)res * sysconf(_SC_PAGESIZE);
+}
+
+static double cpu_s(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+		(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+/* Load generator: n emulated sensors (sim.c) of the given types, round
+   robin, through the same set-up, schedule and output as real ones.
+   Reports sustained readings/s, CPU time per reading and memory per
+   sensor on stderr. */
+static int run_simulation(uint32_t n, const enum sensor_type *types, int ntypes)
+{
+	uint32_t per_type[SENSOR_TYPES] = { 0 };
+	const char *sep = "";
+	uint64_t rss0, rss1, t0, t1;
+	double cpu0, cpu1, dt;
+	uint32_t i, readings = 0;
+	int k;
+
+	rss0 = rss_bytes();
+	if (bus_sim_reserve(n) < 0)
+		return -1;
+	for (i = 0; i < n; i++) {
+		const struct sensor_drv *drv = drivers[types[i % ntypes]];
+		int file = bus_open_sim(drv->type, drv->addr, drv->name);
+
+		if (file < 0)
+			return -1;
+		if (drv->setup(file) < 0 || !add_sensor(drv, file)) {
+			fprintf(stderr, "Error: could not set up emulated sensor %u\n", i);
+			return -1;
+		}
+		per_type[drv->type]++;
+	}
+
+	t0 = lat_now();
+	cpu0 = cpu_s();
+	run_continuous();
+	t1 = lat_now();
+	cpu1 = cpu_s();
+	rss1 = rss_bytes();
+	for (i = 0; i < n; i++)
+		readings += sensors[i].readings;
+
+	dt = (t1 - t0) / 1e9;
+	fprintf(stderr, "Simulated %u sensors (", n);
+	for (k = 1; k < SENSOR_TYPES; k++)
+		if (per_type[k]) {
+			fprintf(stderr, "%s%u %s", sep, per_type[k], drivers[k]->name);
+			sep = ", ";
+		}
+	fprintf(stderr, ") for %.3f s\n", dt);
+	fprintf(stderr, "  readings: %u (%u good), %.1f/s\n", readings,
+		good_readings, dt > 0 ? readings / dt : 0.0);
+	fprintf(stderr, "  CPU: %.2f us/reading, %.3f s (%.0f%% of one core), "
+		"one core would keep up with ~%.0f readings/s\n",
+		readings ? (cpu1 - cpu0) * 1e6 / readings : 0.0, cpu1 - cpu0,
+		dt > 0 ? (cpu1 - cpu0) * 100 / dt : 0.0,
+		cpu1 > cpu0 ? readings / (cpu1 - cpu0) : 0.0);
+	fprintf(stderr, "  memory: %.1f KiB/sensor (RSS +%.1f MiB, arena %.1f MiB)\n",
+		(double)(rss1 - rss0) / n / 1024, (double)(rss1 - rss0) / (1 << 20),
+		(double)arena_used() / (1 << 20));
+	fprintf(stderr, "  start lag (us): p50=%u p99=%u max=%u\n",
+		lat_percentile(&sched_lag, 50), lat_percentile(&sched_lag, 99),
+		sched_lag.max_us);
+	return 0;
+}
+
+static int exporting;       ///< --export: history to a columnar file
+
+// the sensor name of a record; SENSOR_NONE is a fused reading
+static const char *type_name(unsigned type)
+{
+	if (type == SENSOR_NONE)
+		return "FUSED";
+	return type < SENSOR_TYPES && drivers[type] ? drivers[type]->name : "unknown";
+}
+
+static void history_sample(struct sample *s)
+{
+	add_derived(s);
+	if (exporting)
+		export_sample(s);
+	else
+		out_sample(s);
+}
+
+/* Deferred conversion: raw log records (path, "-" for stdin) to
+   readings, converted in batches */
+static int convert_raw_log(const char *path)
+{
+	static struct raw_rec rec[RAW_BATCH];
+	static float temp[RAW_BATCH], humi[RAW_BATCH];
+	FILE *f = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+	struct sample s;
+	size_t n, i;
+
+	if (!f) {
+		fprintf(stderr, "Error: Could not open raw log `%s': %s\n",
+			path, strerror(errno));
+		return -1;
+	}
+	memset(&s, 0, sizeof(s));
+	s.nconv = s.nok = 1;
+	while ((n = fread(rec, sizeof(rec[0]), RAW_BATCH, f)) > 0) {
+		raw_convert(rec, n, temp, humi);
+		for (i = 0; i < n; i++) {
+			unsigned type = RAW_TYPE(&rec[i]);
+
+			s.ts = rec[i].ts;
+			s.type = type;
+			s.sensor = type_name(type);
+			s.addr = RAW_ADDR(&rec[i]);
+			s.status = s.mask = RAW_STATUS(&rec[i]);
+			s.raw_t = rec[i].t & RAW_COUNT_MASK;
+			s.raw_h = rec[i].h & RAW_COUNT_MASK;
+			s.temp = temp[i];
+			s.humi = humi[i];
+			history_sample(&s);
+		}
+	}
+	if (f != stdin)
+		fclose(f);
+	out_flush();
+	return 0;
+}
+
+static void print_jrec(const struct jrec *r, void *arg)
+{
+	struct sample s;
+
+	(void)arg;
+	memset(&s, 0, sizeof(s));
+	s.ts = r->ts;
+	s.id = r->id;
+	s.type = r->type;
+	s.sensor = type_name(r->type);
+	s.addr = r->addr;
+	s.status = s.mask = r->status;
+	s.flags = r->flags;
+	s.nconv = s.nok = 1;
+	s.temp = r->temp;
+	s.humi = r->humi;
+	history_sample(&s);
+}
+
+/* the readings of a journal, up to a torn tail if any */
+static int read_journal(const char *path)
+{
+	long n = journal_read(path, print_jrec, NULL);
+
+	out_flush();
+	return n < 0 ? -1 : 0;
+}
+
+static int read_store(const char *path, double hours)
+{
+	long n = store_read(path, hours, print_jrec, NULL);
+
+	out_flush();
+	return n < 0 ? -1 : 0;
+}
+
+static void parse_seal(const char *arg)
+{
+	char *end;
+	double mib = strtod(arg, &end), min = cfg.seal_s / 60.0;
+
+	if (*end == ',')
+		min = strtod(end + 1, &end);
+	// checked as doubles: a negative one would wrap in the conversion
+	if (end == arg || *end || !(mib * (1 << 20) >= 4096) || mib > 1 << 20 ||
+	    !(min * 60 >= 1) || min > 60 * 24 * 366) {
+		fprintf(stderr, "Error: Invalid segment limit \"%s\"\n", arg);
+		exit(1);
+	}
+	cfg.seal_bytes = mib * (1 << 20);
+	cfg.seal_s = min * 60;
+}
+
+static void parse_rollup(const char *arg)
+{
+	char *end;
+	unsigned long sec = strtoul(arg, &end, 10);
+
+	if (end == arg || *end || *arg == '-' || sec > 86400 * 366) {
+		fprintf(stderr, "Error: --rollup takes SEC from 0 to %u\n", 86400 * 366);
+		exit(1);
+	}
+	cfg.rollup_s = sec;
+}
+
+static void parse_sync(const char *arg)
+{
+	char *end;
+
+	cfg.sync_n = strtoul(arg, &end, 10);
+	if (*end == ',')
+		cfg.sync_ms = strtoul(end + 1, &end, 10);
+	if (end == arg || *end) {
+		fprintf(stderr, "Error: Invalid sync policy \"%s\"\n", arg);
+		exit(1);
+	}
+}
+
+static void parse_deadband(const char *arg)
+{
+	char *end;
+
+	cfg.deadband.on = 1;
+	cfg.deadband.delta[0] = strtof(arg, &end);
+	cfg.deadband.delta[1] = *end == ',' ? strtof(end + 1, &end) :
+		cfg.deadband.delta[0];
+	if (end == arg || *end || cfg.deadband.delta[0] < 0 ||
+	    cfg.deadband.delta[1] < 0) {
+		fprintf(stderr, "Error: Deadband must be TEMP[,HUMI] >= 0\n");
+		exit(1);
+	}
+}
+
+static void parse_heartbeat(const char *arg)
+{
+	char *end;
+	double sec = strtod(arg, &end);
+
+	if (end == arg || *end || !(sec > 0) || sec > 1e9) {
+		fprintf(stderr, "Error: Heartbeat must be SEC > 0\n");
+		exit(1);
+	}
+	cfg.deadband.heartbeat = sec * 1e9;
+}
+
+/* SPEC[,SPEC]: filter for the temperature, and for the humidity if
+   different */
+static void parse_filters(const char *arg)
+{
+	char spec[64];
+	const char *comma = strchr(arg, ',');
+	size_t len = comma ? (size_t)(comma - arg) : strlen(arg);
+
+	snprintf(spec, sizeof(spec), "%.*s", (int)len, arg);
+	if (filter_parse(spec, &cfg.filter[0]) < 0 ||
+	    filter_parse(comma ? comma + 1 : spec, &cfg.filter[1]) < 0) {
+		fprintf(stderr, "Error: Filter must be ema:ALPHA or "
+			"kalman:Q:R (for temp[,humi])\n");
+		exit(1);
+	}
+}
+
+static void parse_windows(const char *arg)
+{
+	char *end;
+
+	cfg.nwindows = 0;
+	do {
+		unsigned long v = strtoul(arg, &end, 10);
+
+		if (end == arg || v == 0 || cfg.nwindows == MAX_WINDOWS) {
+			fprintf(stderr, "Error: Windows must be up to %d "
+				"comma separated periods in seconds\n", MAX_WINDOWS);
+			exit(1);
+		}
+		cfg.window_s[cfg.nwindows++] = v;
+		arg = end + 1;
+	} while (*end == ',');
+}
+
+static void parse_queue(const char *arg)
+{
+	char *end;
+	unsigned long n = strtoul(arg, &end, 10);
+	int pol = OUTQ_DROP_OLDEST;
+
+	if (*end == ':')
+		pol = outq_policy_parse(end + 1);
+	else if (*end)
+		pol = -1;
+	if (end == arg || n < 2 || n > 1000000 || pol < 0) {
+		fprintf(stderr, "Error: --queue takes N[:drop-oldest|drop-newest|rollup], "
+			"N from 2 to 1000000\n");
+		exit(1);
+	}
+	cfg.queue_cap = n;
+	cfg.queue_policy = pol;
+}
+
+static void parse_flush(const char *arg)
+{
+	char *end;
+	unsigned long ms = strtoul(arg, &end, 10);
+
+	if (end == arg || *end || ms == 0 || ms > 3600000) {
+		fprintf(stderr, "Error: --flush-ms takes MS from 1 to 3600000\n");
+		exit(1);
+	}
+	cfg.flush_ms = ms;
+}
+
+// TYPE[@ADDR][:OFFSET[:WEIGHT]][,..]
+static void parse_fuse(const char *arg)
+{
+	const char *p = arg;
+	char *end;
+
+	cfg.nfuse = 0;
+	do {
+		size_t len = strcspn(p, "@:,");
+		int t;
+
+		for (t = 1; t < SENSOR_TYPES; t++)
+			if (strlen(drivers[t]->name) == len &&
+			    !strncasecmp(p, drivers[t]->name, len))
+				break;
+		if (t == SENSOR_TYPES) {
+			fprintf(stderr, "Error: Unknown sensor type \"%.*s\"\n", (int)len, p);
+			exit(1);
+		}
+		if (cfg.nfuse == FUSE_MAX) {
+			fprintf(stderr, "Error: --fuse takes up to %d sensors\n", FUSE_MAX);
+			exit(1);
+		}
+		cfg.fuse[cfg.nfuse].drv = drivers[t];
+		cfg.fuse[cfg.nfuse].addr = drivers[t]->addr;
+		cfg.fuse[cfg.nfuse].offset = 0;
+		cfg.fuse[cfg.nfuse].weight = 1;
+		end = (char *)p + len;
+		if (*end == '@')
+			cfg.fuse[cfg.nfuse].addr = strtol(end + 1, &end, 0);
+		if (*end == ':')
+			cfg.fuse[cfg.nfuse].offset = strtof(end + 1, &end);
+		if (*end == ':')
+			cfg.fuse[cfg.nfuse].weight = strtof(end + 1, &end);
+		if ((*end && *end != ',') || cfg.fuse[cfg.nfuse].weight <= 0 ||
+		    cfg.fuse[cfg.nfuse].addr < 0x03 || cfg.fuse[cfg.nfuse].addr > 0x77) {
+			fprintf(stderr, "Error: --fuse takes TYPE[@ADDR][:OFFSET[:WEIGHT]][,..] "
+				"with WEIGHT > 0, not \"%s\"\n", arg);
+			exit(1);
+		}
+		cfg.nfuse++;
+		p = end + 1;
+	} while (*end == ',');
+}
+
+static void parse_simulate(const char *arg)
+{
+	char *end;
+	unsigned long n = strtoul(arg, &end, 10);
+
+	if (end == arg || n == 0 || n > BUS_SIM_MAX ||
+	    (*end && *end != ':')) {
+		fprintf(stderr, "Error: --simulate takes N[:TYPE[,TYPE..]], "
+			"N up to %d\n", BUS_SIM_MAX);
+		exit(1);
+	}
+	cfg.sim_n = n;
+	cfg.sim_ntypes = 0;
+	if (*end == 0) {
+		cfg.sim_types[cfg.sim_ntypes++] = SENSOR_MCP9801;
+		cfg.sim_types[cfg.sim_ntypes++] = SENSOR_AHT10;
+		cfg.sim_types[cfg.sim_ntypes++] = SENSOR_SHT30;
+		return;
+	}
+	do {
+		size_t len;
+		int t;
+
+		arg = end + 1;
+		len = strcspn(arg, ",");
+		for (t = 1; t < SENSOR_TYPES; t++)
+			if (strlen(drivers[t]->name) == len &&
+			    !strncasecmp(arg, drivers[t]->name, len))
+				break;
+		if (t == SENSOR_TYPES || cfg.sim_ntypes == SENSOR_TYPES) {
+			fprintf(stderr, "Error: Unknown sensor type \"%.*s\"\n",
+				(int)len, arg);
+			exit(1);
+		}
+		cfg.sim_types[cfg.sim_ntypes++] = t;
+		end = (char *)arg + len;
+	} while (*end == ',');
+}
+
 int main(int argc, char *argv[])
 {
-	int res, file, chip_addr = MCP9801_ADDR;
+	int res, file;
 	int flags = 0;
-	uint8_t bare_fmt = 0;
-	float temp, humi;
-	readsensor_fn readsensorfn = read_mcp9801;
+	uint8_t show_deg = 0;
+	const char *deg_name = getenv("ROOM_TEMP_DEG");
+	const char *convert_path = NULL;
+	const char *journal_path = NULL;    // --read-journal
+	const char *store_path = NULL;      // --read-store
+	const char *export_path = NULL;
+	double last_h = 0;
+	size_t bench_frames = 0;
+	size_t bench_records = 0;
+	size_t bench_derived = 0;
+	int check_fuse = 0, check_store = 0;
+	size_t bench_journal = 0;
+	size_t bench_sqlite = 0;
+	struct sample s;
+	double interval;
 
 	/* handle (optional) flags first */
 	while (1+flags < argc && argv[1+flags][0] == '-') {
 		switch (argv[1+flags][1]) {
 		case '2': 
-			chip_addr = AHTX0_ADDR_DEFAULT;
-			readsensorfn = read_aht10; 
+			cfg.drv = &drv_aht10;
 			break;
 		case '3': 
-			chip_addr = SHT30_ADDR_DEFAULT;
-			readsensorfn = read_sht30; 
+			cfg.drv = &drv_sht30;
+			break;
+		case 'n':
+			cfg.nsamples = atoi(opt_arg(argc, argv, &flags));
+			if (cfg.nsamples < 1 || cfg.nsamples > OVERSAMPLE_MAX) {
+				fprintf(stderr, "Error: Number of samples must be "
+					"1..%d\n", OVERSAMPLE_MAX);
+				exit(1);
+			}
+			break;
+		case 'i':
+			interval = atof(opt_arg(argc, argv, &flags));
+			if (interval <= 0) {
+				fprintf(stderr, "Error: Interval must be > 0\n");
+				exit(1);
+			}
+			cfg.interval_ns = interval * 1e9;
+			break;
+		case 'c':
+			cfg.count = strtoul(opt_arg(argc, argv, &flags), NULL, 10);
+			break;
+		case 'w':
+			parse_windows(opt_arg(argc, argv, &flags));
 			break;
 		case 'r': 
-			bare_fmt |= 2; 
+			cfg.bare_fmt |= 2; 
 			break;
 		case 'b': 
-			bare_fmt |= 1; 
+			cfg.bare_fmt |= 1; 
 			break;
 		case 'h': 
 			help();
 			exit(0);
+		case '-':
+			if (!strcmp(argv[1+flags], "--stats")) {
+				cfg.print_stats = 1;
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--profile")) {
+				prof_enable();
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--deg")) {
+				deg_name = opt_arg(argc, argv, &flags);
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--median")) {
+				cfg.use_median = 1;
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--derived")) {
+				cfg.derived = 1;
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--deadband")) {
+				parse_deadband(opt_arg(argc, argv, &flags));
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--heartbeat")) {
+				parse_heartbeat(opt_arg(argc, argv, &flags));
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--filter")) {
+				parse_filters(opt_arg(argc, argv, &flags));
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--filter-state")) {
+				cfg.filter_state = opt_arg(argc, argv, &flags);
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--rep")) {
+				const char *rep = opt_arg(argc, argv, &flags);
+
+				for (sht30_rep_sel = 2; sht30_rep_sel > 0; sht30_rep_sel--)
+					if (!strcmp(rep, sht30_rep[sht30_rep_sel].name))
+						break;
+				if (strcmp(rep, sht30_rep[sht30_rep_sel].name)) {
+					fprintf(stderr, "Error: Repeatability must be "
+						"high, medium or low\n");
+					exit(1);
+				}
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--format")) {
+				int fmt = out_format_parse(opt_arg(argc, argv, &flags));
+
+				if (fmt < 0) {
+					fprintf(stderr, "Error: Format must be json, csv or influx\n");
+					exit(1);
+				}
+				cfg.format = fmt;
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--queue")) {
+				parse_queue(opt_arg(argc, argv, &flags));
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--flush-ms")) {
+				parse_flush(opt_arg(argc, argv, &flags));
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--rt-prio")) {
+				cfg.rt.prio = atoi(opt_arg(argc, argv, &flags));
+				if (cfg.rt.prio < 1 || cfg.rt.prio > 99) {
+					fprintf(stderr, "Error: Priority must be 1-99\n");
+					exit(1);
+				}
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--cpu")) {
+				char *end;
+				const char *arg = opt_arg(argc, argv, &flags);
+
+				cfg.rt.cpu = strtol(arg, &end, 10);
+				if (end == arg || *end || cfg.rt.cpu < 0 ||
+				    cfg.rt.cpu >= sysconf(_SC_NPROCESSORS_CONF)) {
+					fprintf(stderr, "Error: Invalid CPU \"%s\"\n", arg);
+					exit(1);
+				}
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--mlock")) {
+				cfg.rt.mlock = 1;
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--alloc-check")) {
+				if (!alloc_guard_available()) {
+					fprintf(stderr, "Error: --alloc-check needs the room_temp-check build (make check-alloc)\n");
+					exit(1);
+				}
+				cfg.alloc_check = 1;
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--jitter")) {
+				cfg.jitter = 1;
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--raw-log")) {
+				raw_log = raw_log_open(opt_arg(argc, argv, &flags));
+				if (!raw_log)
+					exit(1);
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--record")) {
+				if (trace_record_open(opt_arg(argc, argv, &flags)) < 0)
+					exit(1);
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--replay")) {
+				if (trace_replay_open(opt_arg(argc, argv, &flags)) < 0)
+					exit(1);
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--convert")) {
+				convert_path = opt_arg(argc, argv, &flags);
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--journal")) {
+				cfg.journal = opt_arg(argc, argv, &flags);
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--sync")) {
+				parse_sync(opt_arg(argc, argv, &flags));
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--read-journal")) {
+				journal_path = opt_arg(argc, argv, &flags);
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--store")) {
+				cfg.store = opt_arg(argc, argv, &flags);
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--seal")) {
+				parse_seal(opt_arg(argc, argv, &flags));
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--rollup")) {
+				parse_rollup(opt_arg(argc, argv, &flags));
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--sqlite")) {
+				cfg.sqlite = opt_arg(argc, argv, &flags);
+				if (!db_available()) {
+					fprintf(stderr, "Error: --sqlite needs a build with SQLite (make SQLITE=1)\n");
+					exit(1);
+				}
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--export")) {
+				export_path = opt_arg(argc, argv, &flags);
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--read-store")) {
+				store_path = opt_arg(argc, argv, &flags);
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--last")) {
+				last_h = atof(opt_arg(argc, argv, &flags));
+				if (last_h <= 0) {
+					fprintf(stderr, "Error: Hours must be > 0\n");
+					exit(1);
+				}
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--fuse")) {
+				parse_fuse(opt_arg(argc, argv, &flags));
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--fuse-tol")) {
+				cfg.fuse_tol = atof(opt_arg(argc, argv, &flags));
+				if (cfg.fuse_tol <= 0) {
+					fprintf(stderr, "Error: Tolerance must be > 0\n");
+					exit(1);
+				}
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--simulate")) {
+				parse_simulate(opt_arg(argc, argv, &flags));
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--bench-decode")) {
+				bench_frames = strtoul(opt_arg(argc, argv, &flags), NULL, 0);
+				if (bench_frames == 0) {
+					fprintf(stderr, "Error: Invalid frame count\n");
+					exit(1);
+				}
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--bench-output")) {
+				bench_records = strtoul(opt_arg(argc, argv, &flags), NULL, 0);
+				if (bench_records == 0) {
+					fprintf(stderr, "Error: Invalid record count\n");
+					exit(1);
+				}
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--check-fuse")) {
+				check_fuse = 1;
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--check-store")) {
+				check_store = 1;
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--bench-derived")) {
+				bench_derived = strtoul(opt_arg(argc, argv, &flags), NULL, 0);
+				if (bench_derived == 0) {
+					fprintf(stderr, "Error: Invalid reading count\n");
+					exit(1);
+				}
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--bench-journal")) {
+				bench_journal = strtoul(opt_arg(argc, argv, &flags), NULL, 0);
+				if (bench_journal == 0) {
+					fprintf(stderr, "Error: Invalid record count\n");
+					exit(1);
+				}
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--bench-sqlite")) {
+				bench_sqlite = strtoul(opt_arg(argc, argv, &flags), NULL, 0);
+				if (bench_sqlite == 0) {
+					fprintf(stderr, "Error: Invalid record count\n");
+					exit(1);
+				}
+				break;
+			}
+			if (!strcmp(argv[1+flags], "--show-deg")) {
+				show_deg = 1;
+				break;
+			}
+			/* fall through */
 		default:
 			fprintf(stderr, "Error: Unsupported option "
 				"\"%s\"!\n", argv[1+flags]);
@@ -300,46 +2197,291 @@ int main(int argc, char *argv[])
 	}
 
 
-	file = open(I2CBUS_FILE, O_RDWR);
-	if (file < 0)
-	{
-		fprintf(stderr, "Error: Could not open file `%s': %s\n", I2CBUS_FILE, strerror(errno));
-		if (errno == EACCES)
-			fprintf(stderr, "Run as root?\n");
+	if (cfg.deadband.heartbeat && !cfg.deadband.on) {
+		fprintf(stderr, "Error: --heartbeat needs --deadband\n");
+		exit(1);
+	}
+
+	// SQLite has an allocator of its own, on the heap
+	if (cfg.sqlite && cfg.alloc_check) {
+		fprintf(stderr, "Error: --alloc-check does not go with --sqlite\n");
+		exit(1);
+	}
+
+	if (cfg.nfuse && (cfg.sim_n || cfg.filter_state)) {
+		fprintf(stderr, "Error: --fuse does not go with --simulate or --filter-state\n");
+		exit(1);
+	}
+
+	// bare format is one value per line, with no room for names
+	if (cfg.derived && cfg.bare_fmt && cfg.format == OUT_TEXT) {
+		fprintf(stderr, "Error: --derived does not go with -b or -r\n");
+		exit(1);
+	}
+
+	// window records do not fit the CSV columns
+	if (cfg.nwindows && cfg.format == OUT_CSV) {
+		fprintf(stderr, "Error: -w does not go with --format csv\n");
 		exit(1);
 	}
-	if (ioctl(file, I2C_SLAVE, chip_addr) < 0) {
-		fprintf(stderr,
-			"Error: Could not set address to 0x%02x: %s\n",
-			chip_addr, strerror(errno));
+
+	lat_install_signal();
+	prof_mark(PROF_ARGS);
+
+	if (show_deg) {
+		init_degstr(deg_name);
+		printf("%s\n", degstr);
+		prof_mark(PROF_OUTPUT);
+		exit(0);
+	}
+
+	if (bench_frames) {
+		decode_bench(stdout, bench_frames);
+		exit(0);
+	}
+
+	if (bench_records) {
+		out_bench(stdout, bench_records);
+		exit(0);
+	}
+
+	if (bench_derived) {
+		psychro_bench(stdout, bench_derived);
+		exit(0);
+	}
+
+	if (check_fuse)
+		exit(fuse_check(stdout) ? 3 : 0);
+
+	if (check_store)
+		exit(store_check(stdout, ".") ? 3 : 0);
+
+	if (bench_journal) {
+		journal_bench(stdout, bench_journal, ".");
+		exit(0);
+	}
+
+	if (bench_sqlite) {
+		db_bench(stdout, bench_sqlite, ".");
+		exit(0);
+	}
+
+	if (cfg.derived)
+		psychro_init();
+
+	// history: a raw log, journal or store, printed or exported
+	if (convert_path || journal_path || store_path) {
+		if (export_path) {
+			if (export_open(export_path, cfg.derived) < 0)
+				exit(1);
+			exporting = 1;
+		} else if (cfg.bare_fmt == 0 && cfg.format == OUT_TEXT) {
+			init_degstr(deg_name);
+		}
+		out_init(cfg.bare_fmt, degstr, cfg.format, cfg.derived);
+		if (convert_path)
+			res = convert_raw_log(convert_path);
+		else if (journal_path)
+			res = read_journal(journal_path);
+		else
+			res = read_store(store_path, last_h);
+		if (exporting && export_close() < 0)
+			res = -1;
+		exit(res < 0 ? 1 : 0);
+	}
+	if (export_path) {
+		fprintf(stderr, "Error: --export needs --convert, --read-journal or --read-store\n");
+		exit(1);
+	}
+
+	if (cfg.journal) {
+		if (journal_open(&journal, cfg.journal, cfg.sync_n, cfg.sync_ms) < 0)
+			exit(1);
+		journal_on = sink_on = 1;
+	}
+	if (cfg.store) {
+		struct store_cfg sc = {
+			.seal_bytes = cfg.seal_bytes, .seal_s = cfg.seal_s,
+			.rollup_s = cfg.rollup_s, .sync_n = cfg.sync_n,
+			.sync_ms = cfg.sync_ms,
+			.nsensors = sensor_ids(),
+		};
+
+		if (store_open(cfg.store, &sc) < 0)
+			exit(1);
+		store_on = sink_on = 1;
+	}
+	if (cfg.sqlite) {
+		if (db_open(cfg.sqlite, cfg.sync_n, cfg.sync_ms) < 0)
+			exit(1);
+		db_on = sink_on = 1;
+	}
+
+	if (cfg.sim_n) {
+		if (!cfg.interval_ns) {
+			fprintf(stderr, "Error: --simulate needs -i\n");
+			exit(1);
+		}
+		if (cfg.bare_fmt == 0 && cfg.format == OUT_TEXT)
+			init_degstr(deg_name);
+		out_init(cfg.bare_fmt, degstr, cfg.format, cfg.derived);
+		if (cfg.queue_cap && outq_start(cfg.queue_cap, cfg.queue_policy, cfg.flush_ms) < 0)
+			exit(1);
+		if (rt_apply(&cfg.rt) < 0)
+			exit(1);
+		res = run_simulation(cfg.sim_n, cfg.sim_types, cfg.sim_ntypes);
+		sink_close();
+		if (cfg.print_stats)
+			lat_dump_all(stderr);
+		if (res >= 0 && cfg.alloc_check && (!io_warm || io_allocs))
+			exit(3);
+		exit(res < 0 ? 2 : 0);
+	}
+
+	/* Fusion: the sensors go through the continuous mode, even for one
+	   reading, so that their conversions overlap */
+	if (cfg.nfuse) {
+		uint32_t i;
+		int w;
+
+		for (i = 0; i < cfg.nfuse; i++) {
+			const struct sensor_drv *drv = cfg.fuse[i].drv;
+			struct sensor *se;
+
+			file = bus_open(I2CBUS_FILE, cfg.fuse[i].addr, drv->name);
+			if (file < 0)
+				exit(1);
+			if (drv->setup(file) < 0) {
+				fprintf(stderr, "Sensor read failed - exiting...\n");
+				exit(2);
+			}
+			se = add_sensor(drv, file);
+			if (!se) {
+				fprintf(stderr, "Error: out of memory\n");
+				exit(2);
+			}
+			se->s.addr = cfg.fuse[i].addr;
+			fusion.m[i].offset = cfg.fuse[i].offset;
+			fusion.m[i].weight = cfg.fuse[i].weight;
+		}
+		fusion.n = cfg.nfuse;
+		fusion.tol = cfg.fuse_tol;
+		fuse_win = cfg.nwindows ? arena_alloc(cfg.nwindows * sizeof(*fuse_win)) : NULL;
+		if (cfg.nwindows && !fuse_win) {
+			fprintf(stderr, "Error: out of memory\n");
+			exit(2);
+		}
+		for (w = 0; w < cfg.nwindows; w++)
+			fuse_win[w].period = cfg.window_s[w];
+		fuse_on = 1;
+		if (!cfg.interval_ns) {
+			cfg.interval_ns = 1000000000u;
+			cfg.count = 1;
+		}
+		if (cfg.bare_fmt == 0 && cfg.format == OUT_TEXT)
+			init_degstr(deg_name);
+		out_init(cfg.bare_fmt, degstr, cfg.format, cfg.derived);
+		if (cfg.queue_cap && outq_start(cfg.queue_cap, cfg.queue_policy, cfg.flush_ms) < 0)
+			exit(1);
+		if (rt_apply(&cfg.rt) < 0)
+			exit(1);
+		res = run_continuous() ? 0 : -1;
+		outq_stop();
+		sink_close();
+		for (i = 0; i < cfg.nfuse; i++)
+			bus_close(sensors[i].file);
+		if (trace_mode == TRACE_REPLAY) {
+			if (trace_replay_end() < 0)
+				res = -1;
+			trace_report(stderr);
+		}
+		trace_close();
+		if (cfg.print_stats)
+			lat_dump_all(stderr);
+		if (res >= 0 && cfg.alloc_check && (!io_warm || io_allocs))
+			exit(3);
+		exit(res < 0 ? 2 : 0);
+	}
+
+	file = bus_open(I2CBUS_FILE, cfg.drv->addr, cfg.drv->name);
+	if (file < 0)
 		exit(1);
+
+	if (cfg.bare_fmt == 0 && cfg.format == OUT_TEXT)
+		init_degstr(deg_name);
+	out_init(cfg.bare_fmt, degstr, cfg.format, cfg.derived);
+
+	if (cfg.filter_state)
+		filter_load(cfg.filter_state, filter_st);
+
+	res = cfg.drv->setup(file);
+	if (res >= 0 && cfg.interval_ns) {
+		struct sensor *se = add_sensor(cfg.drv, file);
+
+		if (!se) {
+			fprintf(stderr, "Error: out of memory\n");
+			exit(2);
+		}
+		memcpy(se->filt, filter_st, sizeof(filter_st));
+		if (cfg.queue_cap && outq_start(cfg.queue_cap, cfg.queue_policy, cfg.flush_ms) < 0)
+			exit(1);
+		if (rt_apply(&cfg.rt) < 0)
+			exit(1);
+		res = run_continuous() ? 0 : -1;
+		outq_stop();
+		sink_close();
+		memcpy(filter_st, se->filt, sizeof(filter_st));
+		bus_close(file);
+		if (trace_mode == TRACE_REPLAY) {
+			if (trace_replay_end() < 0)
+				res = -1;
+			trace_report(stderr);
+		}
+		trace_close();
+		if (cfg.filter_state &&
+		    filter_save(cfg.filter_state, filter_st) < 0) {
+			fprintf(stderr, "Error: Could not save filter state to `%s'\n",
+				cfg.filter_state);
+			res = -1;
+		}
+		if (cfg.print_stats)
+			lat_dump_all(stderr);
+		if (res >= 0 && cfg.alloc_check && (!io_warm || io_allocs))
+			exit(3);
+		exit(res < 0 ? 2 : 0);
+	}
+
+	if (res >= 0) {
+		res = take_reading(file, &s);
+		apply_filters(&s, filter_st);
+		add_derived(&s);
+		if (sink_on)
+			sink_sample(&s);
 	}
+	sink_close();
+	if (res > 0 && cfg.filter_state &&
+	    filter_save(cfg.filter_state, filter_st) < 0)
+		fprintf(stderr, "Error: Could not save filter state to `%s'\n",
+			cfg.filter_state);
 
-	res = readsensorfn(file, &temp, &humi);
+	bus_close(file);
+	trace_close();
+	prof_mark(PROF_SENSOR);
 
-	close(file);
+	if (cfg.print_stats)
+		lat_dump_all(stderr);
+	else
+		lat_poll_signal();
+	prof_mark(PROF_OUTPUT);
 
 	if (res <= 0) {
 		fprintf(stderr, "Sensor read failed - exiting...\n");
 		exit(2);
 	}
 
-	if (res < 3 && bare_fmt > 0)
-		bare_fmt = res;
-
-	if (bare_fmt & 0x01)
-		printf("%.2f\n", temp);
-	if (bare_fmt & 0x02)
-		printf("%.1f\n", humi);
-	if (bare_fmt == 0)
-	{
-		setlocale(LC_CTYPE, "");
-		set_degstr();
-		if (res & 0x01)
-			printf("Temp=%.2f%s\n", temp, degstr);
-		if (res & 0x02)
-			printf("Humi=%.1f%%\n", humi);
-	}
+	out_sample(&s);
+	out_flush();
+	prof_mark(PROF_OUTPUT);
 
 	exit(0);
 }
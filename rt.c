@@ -0,0 +1,108 @@
+/* ---------------------------------------------------------------------
+ *                           rt.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Real-time set-up of the sampling thread. It gets a
+ *              SCHED_FIFO priority and a core of its own, and all of
+ *              the process memory is locked, so that neither other
+ *              load nor page faults delay a conversion. Threads that
+ *              the sampling thread starts inherit that, so they call
+ *              rt_helper_thread() to step back down and off its core.
+ * --------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "rt.h"
+
+#define RT_STACK_PREFAULT   (256 * 1024)
+
+static struct rt_cfg rt = { .cpu = -1 };
+static cpu_set_t rt_cpus;           // affinity before pinning
+
+// touch the stack the sampling thread may grow into, while locked
+static void rt_prefault_stack(void)
+{
+	volatile unsigned char stack[RT_STACK_PREFAULT];
+	long page = sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	// a volatile store per page, which the compiler has to keep
+	if (page <= 0)
+		page = 4096;
+	for (i = 0; i < sizeof(stack); i += page)
+		stack[i] = 0;
+	stack[sizeof(stack) - 1] = 0;
+}
+
+int rt_apply(const struct rt_cfg *c)
+{
+	rt = *c;
+	if (sched_getaffinity(0, sizeof(rt_cpus), &rt_cpus) < 0)
+		CPU_ZERO(&rt_cpus);
+	if (c->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(c->cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+			fprintf(stderr, "Error: Could not pin to CPU %d: %s\n",
+				c->cpu, strerror(errno));
+			return -1;
+		}
+	}
+	if (c->prio) {
+		struct sched_param sp = { .sched_priority = c->prio };
+		int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+
+		if (err) {
+			fprintf(stderr, "Error: Could not set SCHED_FIFO priority %d: %s\n",
+				c->prio, strerror(err));
+			if (err == EPERM)
+				fprintf(stderr, "Run as root (or with CAP_SYS_NICE)?\n");
+			return -1;
+		}
+	}
+	if (c->mlock) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+			fprintf(stderr, "Error: Could not lock memory: %s\n",
+				strerror(errno));
+			return -1;
+		}
+		rt_prefault_stack();
+	}
+	return 0;
+}
+
+void rt_helper_thread(void)
+{
+	struct sched_param sp = { .sched_priority = 0 };
+
+	if (rt.prio)
+		pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+	if (rt.cpu >= 0 && CPU_COUNT(&rt_cpus) > 1) {
+		cpu_set_t set = rt_cpus;
+
+		CPU_CLR(rt.cpu, &set);
+		if (CPU_COUNT(&set))
+			sched_setaffinity(0, sizeof(set), &set);
+	}
+}
+
+void rt_describe(FILE *f)
+{
+	fprintf(f, "Sampling thread: %s", rt.prio ? "SCHED_FIFO" : "SCHED_OTHER");
+	if (rt.prio)
+		fprintf(f, " %d", rt.prio);
+	if (rt.cpu >= 0)
+		fprintf(f, ", CPU %d", rt.cpu);
+	fprintf(f, "%s\n", rt.mlock ? ", memory locked" : "");
+}
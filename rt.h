@@ -0,0 +1,28 @@
+/* ---------------------------------------------------------------------
+ *                           rt.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Real-time set-up of the sampling thread: SCHED_FIFO,
+ *              CPU pinning and locked memory
+ * --------------------------------------------------------------------*/
+
+#ifndef RT_H
+#define RT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+struct rt_cfg {
+	int prio;               ///< SCHED_FIFO priority, 0: leave the policy
+	int cpu;                ///< core to pin to, -1: any
+	uint8_t mlock;          ///< mlockall() and pre-fault the stack
+};
+
+int rt_apply(const struct rt_cfg *c);       ///< on the calling thread
+void rt_helper_thread(void);                ///< back to SCHED_OTHER, off the core
+void rt_describe(FILE *f);
+
+#endif /* RT_H */
@@ -0,0 +1,66 @@
+/* ---------------------------------------------------------------------
+ *                           schedule.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Timer queue (binary min-heap) for stepping many sensors
+ *              from one thread. Events due at the same time come out
+ *              in sensor order, so that runs are reproducible.
+ * --------------------------------------------------------------------*/
+
+#include "arena.h"
+#include "schedule.h"
+
+static int ev_before(const struct sched_ev *a, const struct sched_ev *b)
+{
+	return a->due < b->due || (a->due == b->due && a->id < b->id);
+}
+
+int sched_init(struct sched *q, uint32_t cap)
+{
+	q->ev = arena_alloc(cap * sizeof(*q->ev));
+	q->n = 0;
+	q->cap = q->ev ? cap : 0;
+	return q->ev ? 0 : -1;
+}
+
+// the caller keeps at most cap events queued
+void sched_push(struct sched *q, uint64_t due, uint32_t id)
+{
+	struct sched_ev e = { due, id };
+	uint32_t i = q->n++;
+
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2;
+
+		if (!ev_before(&e, &q->ev[parent]))
+			break;
+		q->ev[i] = q->ev[parent];
+		i = parent;
+	}
+	q->ev[i] = e;
+}
+
+struct sched_ev sched_pop(struct sched *q)
+{
+	struct sched_ev top = q->ev[0], last = q->ev[--q->n];
+	uint32_t i = 0;
+
+	for (;;) {
+		uint32_t c = 2 * i + 1;
+
+		if (c >= q->n)
+			break;
+		if (c + 1 < q->n && ev_before(&q->ev[c + 1], &q->ev[c]))
+			c++;
+		if (!ev_before(&q->ev[c], &last))
+			break;
+		q->ev[i] = q->ev[c];
+		i = c;
+	}
+	if (q->n)
+		q->ev[i] = last;
+	return top;
+}
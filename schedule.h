@@ -0,0 +1,38 @@
+/* ---------------------------------------------------------------------
+ *                           schedule.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Timer queue (binary min-heap) for stepping many sensors
+ *              from one thread
+ * --------------------------------------------------------------------*/
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+
+struct sched_ev {
+	uint64_t due;           ///< CLOCK_MONOTONIC, ns
+	uint32_t id;            ///< sensor index
+};
+
+// room for cap events, one per sensor is enough
+struct sched {
+	struct sched_ev *ev;
+	uint32_t n;
+	uint32_t cap;
+};
+
+int sched_init(struct sched *q, uint32_t cap);     ///< events in the arena
+void sched_push(struct sched *q, uint64_t due, uint32_t id);
+struct sched_ev sched_pop(struct sched *q);
+
+static inline const struct sched_ev *sched_peek(const struct sched *q)
+{
+	return q->n ? &q->ev[0] : NULL;
+}
+
+#endif /* SCHEDULE_H */
@@ -0,0 +1,268 @@
+/* ---------------------------------------------------------------------
+ *                           sim.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Emulated MCP9801, AHT10 and SHT30 sensors, answering
+ *              the SMBus transactions of the drivers like the real
+ *              parts do: conversions take their typical time (with
+ *              some jitter), an AHT10 reports busy and an SHT30 NACKs
+ *              until the result is there, an MCP9801 converts on its
+ *              own. Each sensor sees its own slowly varying climate
+ *              plus noise of the size the datasheets give. Bus
+ *              transfer times are not emulated.
+ * --------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "latency.h"
+#include "sim.h"
+
+#define MCP9801_CONV_NS     240000000u  ///< 12 bit, typical
+#define AHT10_CONV_NS       75000000u
+#define CLIMATE_PERIOD_S    3600.0
+
+// typical SHT30 conversion time and noise (1 sigma) by repeatability
+static const struct {
+	uint8_t lsb;
+	uint32_t conv_ns;
+	float t_sd, h_sd;
+} sht30_rep[] = {
+	{ 0x00, 12500000u, 0.02f, 0.05f },
+	{ 0x0B,  4500000u, 0.04f, 0.10f },
+	{ 0x16,  2500000u, 0.07f, 0.15f },
+};
+
+struct sim_dev {
+	uint8_t type;               ///< enum sensor_type
+	uint8_t reg;                ///< AHT10 status, MCP9801 config register
+	uint8_t rep;                ///< SHT30 repeatability, index in sht30_rep
+	uint32_t rng;
+	uint64_t ready;             ///< end of the conversion under way
+	uint64_t mcp_tick;          ///< MCP9801: conversion the register holds
+	float t_mean, h_mean;       ///< climate this sensor sees
+	float phase;
+	uint8_t frame[6];           ///< result of the last conversion
+};
+
+static uint32_t sim_rand(struct sim_dev *d)
+{
+	uint32_t x = d->rng;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return d->rng = x;
+}
+
+static float sim_uniform(struct sim_dev *d)
+{
+	return (sim_rand(d) >> 8) * (1.0f / 16777216) + 1e-9f;
+}
+
+// Box-Muller, one of the pair
+static float sim_gauss(struct sim_dev *d, float sd)
+{
+	float u = sim_uniform(d), v = sim_uniform(d);
+
+	return sd * sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * v);
+}
+
+static void sim_climate(struct sim_dev *d, uint64_t now, float t_sd, float h_sd,
+			float *temp, float *humi)
+{
+	float a = 6.2831853f * (float)fmod(now / 1e9 / CLIMATE_PERIOD_S, 1.0) + d->phase;
+
+	*temp = d->t_mean + 0.5f * sinf(a) + sim_gauss(d, t_sd);
+	*humi = d->h_mean - 2.0f * sinf(a) + sim_gauss(d, h_sd);
+	if (*humi < 0)
+		*humi = 0;
+	if (*humi > 100)
+		*humi = 100;
+}
+
+static uint32_t sim_count(float v, float off, float scale, uint32_t max)
+{
+	float c = (v - off) / scale + 0.5f;
+
+	return c < 0 ? 0 : c > max ? max : (uint32_t)c;
+}
+
+static uint8_t sht30_crc(const uint8_t *p)
+{
+	uint8_t crc = 0xff;
+	int i, b;
+
+	for (i = 0; i < 2; i++) {
+		crc ^= p[i];
+		for (b = 0; b < 8; b++)
+			crc = crc & 0x80 ? (crc << 1) ^ 0x31 : crc << 1;
+	}
+	return crc;
+}
+
+// the conversion as of now, into d->frame; the result is there at d->ready
+static void sim_convert(struct sim_dev *d, uint64_t now)
+{
+	const struct raw_scale *sc = &raw_scales[d->type];
+	float temp, humi, jitter;
+	uint32_t t, h;
+
+	jitter = 1.0f + 0.05f * (sim_uniform(d) - 0.5f);
+	if (d->type == SENSOR_AHT10) {
+		sim_climate(d, now, 0.05f, 0.3f, &temp, &humi);
+		t = sim_count(temp, sc->t_off, sc->t_scale, 0xfffff);
+		h = sim_count(humi, sc->h_off, sc->h_scale, 0xfffff);
+		d->frame[0] = 0x08;
+		d->frame[1] = h >> 12;
+		d->frame[2] = h >> 4;
+		d->frame[3] = (h & 0x0f) << 4 | t >> 16;
+		d->frame[4] = t >> 8;
+		d->frame[5] = t;
+		d->ready = now + (uint64_t)(AHT10_CONV_NS * jitter);
+	} else if (d->type == SENSOR_SHT30) {
+		sim_climate(d, now, sht30_rep[d->rep].t_sd, sht30_rep[d->rep].h_sd,
+			    &temp, &humi);
+		t = sim_count(temp, sc->t_off, sc->t_scale, 0xffff);
+		h = sim_count(humi, sc->h_off, sc->h_scale, 0xffff);
+		d->frame[0] = t >> 8;
+		d->frame[1] = t;
+		d->frame[2] = sht30_crc(&d->frame[0]);
+		d->frame[3] = h >> 8;
+		d->frame[4] = h;
+		d->frame[5] = sht30_crc(&d->frame[3]);
+		d->ready = now + (uint64_t)(sht30_rep[d->rep].conv_ns * jitter);
+	} else {
+		// 12 bit two's complement, left aligned
+		sim_climate(d, now, 0.03f, 0, &temp, &humi);
+		t = (uint32_t)(int32_t)lrintf(temp * 16) << 4;
+		d->frame[0] = t >> 8;
+		d->frame[1] = t;
+	}
+}
+
+struct sim_dev *sim_new(enum sensor_type type, uint32_t seed)
+{
+	struct sim_dev *d = arena_alloc(sizeof(*d));
+
+	if (!d)
+		return NULL;
+	d->type = type;
+	d->rng = seed * 2654435761u | 1;
+	d->t_mean = 21.0f + 2.0f * sim_uniform(d);
+	d->h_mean = 40.0f + 15.0f * sim_uniform(d);
+	d->phase = 6.2831853f * sim_uniform(d);
+	d->mcp_tick = UINT64_MAX;
+	// MCP9801s as left configured (12 bit) by an earlier run, so that
+	// thousands of them need no set-up delay
+	if (type == SENSOR_MCP9801)
+		d->reg = 0x60;
+	return d;
+}
+
+static int32_t sim_mcp9801(struct sim_dev *d, enum probe_op op, uint8_t cmd,
+			   const uint8_t *wr, uint64_t now)
+{
+	uint64_t tick;
+
+	switch (op) {
+	case PROBE_OP_READ_BYTE_DATA:
+		return cmd == 1 ? d->reg : -EIO;
+	case PROBE_OP_WRITE_BYTE_DATA:
+		if (cmd != 1)
+			return -EIO;
+		d->reg = wr[0];
+		return 0;
+	case PROBE_OP_READ_WORD_DATA:
+		if (cmd != 0)
+			return -EIO;
+		// converts continuously, the register holds the last result
+		tick = now / MCP9801_CONV_NS;
+		if (tick != d->mcp_tick) {
+			sim_convert(d, now);
+			d->mcp_tick = tick;
+		}
+		// SMBus words are little endian
+		return d->frame[0] | d->frame[1] << 8;
+	default:
+		return -EIO;
+	}
+}
+
+static int32_t sim_aht10(struct sim_dev *d, enum probe_op op, uint8_t cmd,
+			 uint8_t len, uint8_t *rd, uint64_t now)
+{
+	uint8_t busy = now < d->ready ? 0x80 : 0;
+
+	switch (op) {
+	case PROBE_OP_WRITE_BLOCK:
+		if (cmd == 0xE1) {
+			d->reg = 0x08;  // calibrated
+		} else if (cmd == 0xAC) {
+			sim_convert(d, now);
+		} else {
+			return -EIO;
+		}
+		return 0;
+	case PROBE_OP_READ_BYTE:
+		return d->reg | busy;
+	case PROBE_OP_READ_BLOCK:
+		memcpy(rd, d->frame, len < 6 ? len : 6);
+		rd[0] = d->reg | busy;
+		return len < 6 ? len : 6;
+	default:
+		return -EIO;
+	}
+}
+
+static int32_t sim_sht30(struct sim_dev *d, enum probe_op op, uint8_t cmd,
+			 uint8_t len, const uint8_t *wr, uint8_t *rd, uint64_t now)
+{
+	unsigned i;
+
+	switch (op) {
+	case PROBE_OP_WRITE_BYTE_DATA:
+		if (cmd != 0x24)
+			return -EIO;
+		for (i = 0; i < sizeof(sht30_rep) / sizeof(sht30_rep[0]); i++)
+			if (sht30_rep[i].lsb == wr[0])
+				break;
+		if (i == sizeof(sht30_rep) / sizeof(sht30_rep[0]))
+			return -EIO;
+		d->rep = i;
+		sim_convert(d, now);
+		return 0;
+	case PROBE_OP_READ_BLOCK:
+		// NACK while converting or with no conversion to read
+		if (d->ready == 0 || now < d->ready)
+			return -EIO;
+		d->ready = 0;
+		memcpy(rd, d->frame, len < 6 ? len : 6);
+		return len < 6 ? len : 6;
+	default:
+		return -EIO;
+	}
+}
+
+int32_t sim_xfer(struct sim_dev *d, enum probe_op op, uint8_t cmd, uint8_t len,
+		 const uint8_t *wr, uint8_t *rd)
+{
+	uint64_t now = lat_now();
+
+	switch (d->type) {
+	case SENSOR_MCP9801:
+		return sim_mcp9801(d, op, cmd, wr, now);
+	case SENSOR_AHT10:
+		return sim_aht10(d, op, cmd, len, rd, now);
+	case SENSOR_SHT30:
+		return sim_sht30(d, op, cmd, len, wr, rd, now);
+	default:
+		return -EIO;
+	}
+}
@@ -0,0 +1,26 @@
+/* ---------------------------------------------------------------------
+ *                           sim.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Emulated MCP9801, AHT10 and SHT30 sensors, answering
+ *              the SMBus transactions of the drivers
+ * --------------------------------------------------------------------*/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+#include "probes.h"
+#include "raw.h"
+
+struct sim_dev;
+
+struct sim_dev *sim_new(enum sensor_type type, uint32_t seed);  ///< in the arena
+int32_t sim_xfer(struct sim_dev *d, enum probe_op op, uint8_t cmd, uint8_t len,
+		 const uint8_t *wr, uint8_t *rd);
+
+#endif /* SIM_H */
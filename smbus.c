@@ -0,0 +1,104 @@
+/* ---------------------------------------------------------------------
+ *                           smbus.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Built-in SMBus transport over the raw I2C_SMBUS ioctl,
+ *              a drop-in for the subset of libi2c used by room_temp.
+ *              Return values follow libi2c: data (>= 0) on success,
+ *              -errno on failure.
+ * --------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "smbus.h"
+
+static __s32 smbus_access(int file, char read_write, __u8 command,
+			  int size, union i2c_smbus_data *data)
+{
+	struct i2c_smbus_ioctl_data args;
+
+	args.read_write = read_write;
+	args.command = command;
+	args.size = size;
+	args.data = data;
+	return ioctl(file, I2C_SMBUS, &args) < 0 ? -errno : 0;
+}
+
+__s32 i2c_smbus_read_byte(int file)
+{
+	union i2c_smbus_data data;
+	__s32 err = smbus_access(file, I2C_SMBUS_READ, 0, I2C_SMBUS_BYTE, &data);
+
+	return err < 0 ? err : data.byte;
+}
+
+__s32 i2c_smbus_write_byte(int file, __u8 value)
+{
+	return smbus_access(file, I2C_SMBUS_WRITE, value, I2C_SMBUS_BYTE, NULL);
+}
+
+__s32 i2c_smbus_read_byte_data(int file, __u8 command)
+{
+	union i2c_smbus_data data;
+	__s32 err = smbus_access(file, I2C_SMBUS_READ, command,
+				 I2C_SMBUS_BYTE_DATA, &data);
+
+	return err < 0 ? err : data.byte;
+}
+
+__s32 i2c_smbus_write_byte_data(int file, __u8 command, __u8 value)
+{
+	union i2c_smbus_data data;
+
+	data.byte = value;
+	return smbus_access(file, I2C_SMBUS_WRITE, command,
+			    I2C_SMBUS_BYTE_DATA, &data);
+}
+
+__s32 i2c_smbus_read_word_data(int file, __u8 command)
+{
+	union i2c_smbus_data data;
+	__s32 err = smbus_access(file, I2C_SMBUS_READ, command,
+				 I2C_SMBUS_WORD_DATA, &data);
+
+	return err < 0 ? err : data.word;
+}
+
+__s32 i2c_smbus_read_i2c_block_data(int file, __u8 command, __u8 length,
+				    __u8 *values)
+{
+	union i2c_smbus_data data;
+	__s32 err;
+
+	if (length > I2C_SMBUS_BLOCK_MAX)
+		length = I2C_SMBUS_BLOCK_MAX;
+	data.block[0] = length;
+	err = smbus_access(file, I2C_SMBUS_READ, command,
+			   length == I2C_SMBUS_BLOCK_MAX ?
+			   I2C_SMBUS_I2C_BLOCK_BROKEN : I2C_SMBUS_I2C_BLOCK_DATA,
+			   &data);
+	if (err < 0)
+		return err;
+	memcpy(values, &data.block[1], data.block[0]);
+	return data.block[0];
+}
+
+__s32 i2c_smbus_write_i2c_block_data(int file, __u8 command, __u8 length,
+				     const __u8 *values)
+{
+	union i2c_smbus_data data;
+
+	if (length > I2C_SMBUS_BLOCK_MAX)
+		length = I2C_SMBUS_BLOCK_MAX;
+	memcpy(&data.block[1], values, length);
+	data.block[0] = length;
+	return smbus_access(file, I2C_SMBUS_WRITE, command,
+			    I2C_SMBUS_I2C_BLOCK_BROKEN, &data);
+}
@@ -0,0 +1,29 @@
+/* ---------------------------------------------------------------------
+ *                           smbus.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Built-in SMBus transport over the raw I2C_SMBUS ioctl,
+ *              a drop-in for the subset of libi2c used by room_temp.
+ *              Used instead of libi2c when built with INTERNAL_SMBUS
+ *              (make static).
+ * --------------------------------------------------------------------*/
+
+#ifndef SMBUS_H
+#define SMBUS_H
+
+#include <linux/types.h>
+
+__s32 i2c_smbus_read_byte(int file);
+__s32 i2c_smbus_write_byte(int file, __u8 value);
+__s32 i2c_smbus_read_byte_data(int file, __u8 command);
+__s32 i2c_smbus_write_byte_data(int file, __u8 command, __u8 value);
+__s32 i2c_smbus_read_word_data(int file, __u8 command);
+__s32 i2c_smbus_read_i2c_block_data(int file, __u8 command, __u8 length,
+				    __u8 *values);
+__s32 i2c_smbus_write_i2c_block_data(int file, __u8 command, __u8 length,
+				     const __u8 *values);
+
+#endif /* SMBUS_H */
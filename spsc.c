@@ -0,0 +1,31 @@
+/* ---------------------------------------------------------------------
+ *                           spsc.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Lock-free single-producer/single-consumer ring of
+ *              fixed-size records. All memory is allocated up front,
+ *              pushing and taking never allocate, lock or block.
+ * --------------------------------------------------------------------*/
+
+#include <string.h>
+
+#include "arena.h"
+#include "spsc.h"
+
+int spsc_init(struct spsc *q, size_t n, size_t size)
+{
+	size_t slots = 1;
+
+	while (slots < n)
+		slots <<= 1;
+	memset(q, 0, sizeof(*q));
+	q->buf = arena_alloc(slots * size);
+	if (!q->buf)
+		return -1;
+	q->mask = slots - 1;
+	q->size = size;
+	return 0;
+}
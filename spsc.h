@@ -0,0 +1,73 @@
+/* ---------------------------------------------------------------------
+ *                           spsc.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Lock-free single-producer/single-consumer ring of
+ *              fixed-size records
+ * --------------------------------------------------------------------*/
+
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+// The producer owns head, the consumer tail; each keeps a copy of the
+// other's index and only reloads it when the ring looks full (empty),
+// so the cache lines bounce once per batch, not once per record.
+struct spsc {
+	_Alignas(64) atomic_size_t head;    ///< next slot to fill
+	size_t tail_seen;                   ///< producer's copy of tail
+	_Alignas(64) atomic_size_t tail;    ///< next slot to take
+	size_t head_seen;                   ///< consumer's copy of head
+	_Alignas(64) unsigned char *buf;
+	size_t mask;                        ///< slots - 1, a power of 2
+	size_t size;                        ///< bytes per record
+};
+
+int spsc_init(struct spsc *q, size_t n, size_t size);   ///< n rounded up to 2^k, in the arena
+
+// producer: the slot to fill, NULL when full; then spsc_publish()
+static inline void *spsc_claim(struct spsc *q)
+{
+	size_t h = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	if (h - q->tail_seen > q->mask) {
+		q->tail_seen = atomic_load_explicit(&q->tail, memory_order_acquire);
+		if (h - q->tail_seen > q->mask)
+			return NULL;
+	}
+	return q->buf + (h & q->mask) * q->size;
+}
+
+static inline void spsc_publish(struct spsc *q)
+{
+	size_t h = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	atomic_store_explicit(&q->head, h + 1, memory_order_release);
+}
+
+// consumer: the oldest record, NULL when empty; then spsc_release()
+static inline void *spsc_front(struct spsc *q)
+{
+	size_t t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	if (t == q->head_seen) {
+		q->head_seen = atomic_load_explicit(&q->head, memory_order_acquire);
+		if (t == q->head_seen)
+			return NULL;
+	}
+	return q->buf + (t & q->mask) * q->size;
+}
+
+static inline void spsc_release(struct spsc *q)
+{
+	size_t t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	atomic_store_explicit(&q->tail, t + 1, memory_order_release);
+}
+
+#endif /* SPSC_H */
@@ -0,0 +1,226 @@
+/* ---------------------------------------------------------------------
+ *                           stats.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Statistics over sensor readings
+ * --------------------------------------------------------------------*/
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "stats.h"
+
+// readings further than ROBUST_LIMIT scaled MADs from the median
+// are rejected as outliers (1.4826 * MAD estimates sigma for a normal
+// distribution, so this is about 3 sigma)
+#define ROBUST_LIMIT        3.0
+#define MAD_TO_SIGMA        1.4826
+
+static int cmp_float(const void *a, const void *b)
+{
+	float x = *(const float *)a, y = *(const float *)b;
+
+	return (x > y) - (x < y);
+}
+
+static float median_sorted(const float *v, int n)
+{
+	return n & 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// Sorts v in place. Outliers are rejected around the median using the
+// median absolute deviation, which a single spike cannot inflate (as it
+// would inflate the standard deviation).
+void robust_reduce(float *v, int n, struct robust *r)
+{
+	float dev[n], limit;
+	double sum = 0, sum2 = 0;
+	int i;
+
+	r->n = n;
+	r->kept = 0;
+	r->mean = r->median = r->sd = 0;
+	if (n <= 0)
+		return;
+
+	qsort(v, n, sizeof(*v), cmp_float);
+	r->median = median_sorted(v, n);
+
+	for (i = 0; i < n; i++)
+		dev[i] = fabsf(v[i] - r->median);
+	qsort(dev, n, sizeof(*dev), cmp_float);
+	limit = ROBUST_LIMIT * MAD_TO_SIGMA * median_sorted(dev, n);
+
+	for (i = 0; i < n; i++) {
+		// with MAD 0 (mostly identical readings) keep everything
+		if (limit > 0 && fabsf(v[i] - r->median) > limit)
+			continue;
+		sum += v[i];
+		r->kept++;
+	}
+	r->mean = sum / r->kept;
+	for (i = 0; i < n; i++) {
+		if (limit > 0 && fabsf(v[i] - r->median) > limit)
+			continue;
+		sum2 += (v[i] - r->mean) * (v[i] - r->mean);
+	}
+	r->sd = r->kept > 1 ? sqrt(sum2 / (r->kept - 1)) : 0;
+}
+
+void welford_reset(struct welford *w)
+{
+	w->n = 0;
+	w->mean = w->m2 = 0;
+	w->min = w->max = 0;
+}
+
+void welford_add(struct welford *w, float x)
+{
+	double d = x - w->mean;
+
+	if (w->n == 0 || x < w->min)
+		w->min = x;
+	if (w->n == 0 || x > w->max)
+		w->max = x;
+	w->n++;
+	w->mean += d / w->n;
+	w->m2 += d * (x - w->mean);
+}
+
+double welford_sd(const struct welford *w)
+{
+	return w->n > 1 ? sqrt(w->m2 / (w->n - 1)) : 0;
+}
+
+void p2_reset(struct p2_quantile *e, double p)
+{
+	e->p = p;
+	e->n = 0;
+}
+
+static double p2_parabolic(const struct p2_quantile *e, int i, int d)
+{
+	const double *q = e->q, *n = e->pos;
+
+	return q[i] + d / (n[i+1] - n[i-1]) *
+		((n[i] - n[i-1] + d) * (q[i+1] - q[i]) / (n[i+1] - n[i]) +
+		 (n[i+1] - n[i] - d) * (q[i] - q[i-1]) / (n[i] - n[i-1]));
+}
+
+void p2_add(struct p2_quantile *e, double x)
+{
+	const double p = e->p;
+	const double inc[5] = { 0, p / 2, p, (1 + p) / 2, 1 };
+	int i, k;
+
+	// the first five observations are kept sorted as the markers
+	if (e->n < 5) {
+		for (i = e->n; i > 0 && e->q[i-1] > x; i--)
+			e->q[i] = e->q[i-1];
+		e->q[i] = x;
+		if (++e->n == 5) {
+			for (i = 0; i < 5; i++)
+				e->pos[i] = i;
+			e->want[0] = 0;
+			e->want[1] = 2 * p;
+			e->want[2] = 4 * p;
+			e->want[3] = 2 + 2 * p;
+			e->want[4] = 4;
+		}
+		return;
+	}
+
+	if (x < e->q[0]) {
+		e->q[0] = x;
+		k = 0;
+	} else if (x >= e->q[4]) {
+		e->q[4] = x;
+		k = 3;
+	} else {
+		for (k = 0; k < 3 && x >= e->q[k+1]; k++)
+			;
+	}
+	for (i = k + 1; i < 5; i++)
+		e->pos[i]++;
+	for (i = 0; i < 5; i++)
+		e->want[i] += inc[i];
+	e->n++;
+
+	// move the middle markers towards their desired positions
+	for (i = 1; i < 4; i++) {
+		double d = e->want[i] - e->pos[i];
+
+		if ((d >= 1 && e->pos[i+1] - e->pos[i] > 1) ||
+		    (d <= -1 && e->pos[i-1] - e->pos[i] < -1)) {
+			int s = d > 0 ? 1 : -1;
+			double q = p2_parabolic(e, i, s);
+
+			if (e->q[i-1] < q && q < e->q[i+1])
+				e->q[i] = q;
+			else
+				e->q[i] += s * (e->q[i+s] - e->q[i]) /
+					(e->pos[i+s] - e->pos[i]);
+			e->pos[i] += s;
+		}
+	}
+}
+
+double p2_get(const struct p2_quantile *e)
+{
+	int i;
+
+	if (e->n == 0)
+		return 0;
+	if (e->n <= 5) {
+		// exact quantile of the few sorted observations
+		i = (int)(e->p * (e->n - 1) + 0.5);
+		return e->q[i];
+	}
+	return e->q[2];
+}
+
+const double qstats_quantiles[QSTATS_NQ] = { 0.05, 0.5, 0.95 };
+
+void qstats_reset(struct qstats *s)
+{
+	int i;
+
+	welford_reset(&s->w);
+	for (i = 0; i < QSTATS_NQ; i++)
+		p2_reset(&s->q[i], qstats_quantiles[i]);
+}
+
+void qstats_add(struct qstats *s, float x)
+{
+	int i;
+
+	welford_add(&s->w, x);
+	for (i = 0; i < QSTATS_NQ; i++)
+		p2_add(&s->q[i], x);
+}
+
+void window_reset(struct window *w, uint64_t now_s)
+{
+	w->start = now_s - now_s % w->period;
+	w->caps = 0;
+	qstats_reset(&w->temp);
+	qstats_reset(&w->humi);
+}
+
+// the sample taken at now_s belongs to a later window
+int window_due(const struct window *w, uint64_t now_s)
+{
+	return now_s >= w->start + w->period;
+}
+
+void window_add(struct window *w, uint8_t caps, float temp, float humi)
+{
+	w->caps |= caps;
+	if (caps & 0x01)
+		qstats_add(&w->temp, temp);
+	if (caps & 0x02)
+		qstats_add(&w->humi, humi);
+}
@@ -0,0 +1,81 @@
+/* ---------------------------------------------------------------------
+ *                           stats.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Statistics over sensor readings
+ * --------------------------------------------------------------------*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// result of reducing a burst of oversampled readings
+struct robust {
+	float mean;     ///< mean of the readings kept
+	float median;   ///< median of all readings
+	float sd;       ///< standard deviation of the readings kept
+	int kept;       ///< readings within the outlier limit
+	int n;          ///< all readings
+};
+
+void robust_reduce(float *v, int n, struct robust *r);
+
+// running mean/variance (Welford) with min and max
+struct welford {
+	uint32_t n;
+	double mean;
+	double m2;      ///< sum of squared deviations from the mean
+	float min;
+	float max;
+};
+
+void welford_reset(struct welford *w);
+void welford_add(struct welford *w, float x);
+double welford_sd(const struct welford *w);
+
+// P-square quantile estimator (Jain & Chlamtac, 1985): tracks one
+// quantile with five markers, in O(1) time and memory per observation
+struct p2_quantile {
+	double p;       ///< quantile, 0..1
+	uint32_t n;     ///< observations so far
+	double q[5];    ///< marker heights
+	double pos[5];  ///< actual marker positions
+	double want[5]; ///< desired marker positions
+};
+
+void p2_reset(struct p2_quantile *e, double p);
+void p2_add(struct p2_quantile *e, double x);
+double p2_get(const struct p2_quantile *e);
+
+// streaming summary of one quantity: mean, sd, min/max, p5/p50/p95
+#define QSTATS_NQ   3
+extern const double qstats_quantiles[QSTATS_NQ];
+
+struct qstats {
+	struct welford w;
+	struct p2_quantile q[QSTATS_NQ];
+};
+
+void qstats_reset(struct qstats *s);
+void qstats_add(struct qstats *s, float x);
+
+// Tumbling window aligned to multiples of its period (wall clock).
+// Removing old samples from a sliding window would need the samples
+// themselves; aligned windows keep O(1) memory and line up across hosts.
+struct window {
+	uint32_t period;    ///< seconds
+	uint64_t start;     ///< window start, unix seconds
+	uint8_t caps;       ///< quantities seen, as readsensor_fn returns
+	struct qstats temp;
+	struct qstats humi;
+};
+
+void window_reset(struct window *w, uint64_t now_s);
+int window_due(const struct window *w, uint64_t now_s);
+void window_add(struct window *w, uint8_t caps, float temp, float humi);
+
+#endif /* STATS_H */
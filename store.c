@@ -0,0 +1,716 @@
+/* ---------------------------------------------------------------------
+ *                           store.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Segmented storage. A directory of journal segments,
+ *              named after their number and the time span they cover,
+ *              so the names are the index:
+ *
+ *                NNNNNNNN.open         being written
+ *                NNNNNNNN-FIRST-LAST.raw   sealed, every reading
+ *                NNNNNNNN-FIRST-LAST.roll  compacted, a mean per sensor
+ *                                      and rollup_s bucket
+ *
+ *              (FIRST/LAST: reading timestamps, s). A segment is
+ *              preallocated to the size limit and sealed, at that size
+ *              or age, by rename. A compaction thread rolls sealed
+ *              segments up into a .roll written under a temporary name,
+ *              synced, renamed into place, and only then unlinks the
+ *              .raw. Renames are atomic and an unlinked file stays
+ *              readable while open, so readers take no lock and never
+ *              wait for the compaction; a reader that loses a .raw to
+ *              it goes on with the .roll. Closing the store leaves the
+ *              open segment open; the next run appends to it, so short
+ *              runs (cron) share a segment until it reaches a limit.
+ *              Opening the store also finishes what a crash interrupted.
+ *              One process writes a store at a time: it holds a flock
+ *              on the directory from store_open() to store_close().
+ * --------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "arena.h"
+#include "raw.h"
+#include "rt.h"
+#include "store.h"
+
+#define STORE_QUEUE         64      ///< sealed segments waiting for compaction
+#define ACC_WAYS            2       ///< rollups per sensor id and bucket
+
+enum seg_kind {
+	SEG_OPEN,
+	SEG_RAW,
+	SEG_ROLL,
+	SEG_TMP,
+};
+
+static const char *const seg_ext[] = {
+	[SEG_OPEN] = "open",
+	[SEG_RAW]  = "raw",
+	[SEG_ROLL] = "roll",
+	[SEG_TMP]  = "tmp",
+};
+
+struct seg_ent {
+	unsigned no;
+	uint8_t kind;           ///< enum seg_kind
+	unsigned long long first, last;     ///< s, not known for SEG_OPEN
+};
+
+static char dir[PATH_MAX / 2];
+static int dir_fd = -1;
+static struct store_cfg cfg;
+
+// the segment being written, on the I/O thread
+static struct journal seg;
+static char seg_path[PATH_MAX];
+static int seg_open;
+static unsigned seg_no, seg_next;
+static uint64_t seg_first, seg_min, seg_max;   // s
+
+// compaction
+static struct seg_ent queue[STORE_QUEUE];
+static size_t qhead, qcount;
+static unsigned backlog;                // sealed, not queued
+static int comp_on, stopping;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_t compactor;
+static struct journal out;              // the .roll under way
+
+// rollup of one sensor over one bucket; runs that share a segment
+// may give one id to different sensors (a default run, then -3: both
+// id 0), so an id has ACC_WAYS of them, told apart by addr and type
+struct acc {
+	uint64_t bucket;        ///< start, s
+	uint32_t nt, nh;
+	double t, h;
+	uint8_t addr, type;
+};
+
+static struct acc *acc;                 // cfg.nsensors * ACC_WAYS
+
+static void seg_name(char *buf, const struct seg_ent *e)
+{
+	if (e->kind == SEG_OPEN)
+		snprintf(buf, PATH_MAX, "%s/%08u.open", dir, e->no);
+	else
+		snprintf(buf, PATH_MAX, "%s/%08u-%llu-%llu.%s", dir, e->no,
+			 e->first, e->last, seg_ext[e->kind]);
+}
+
+static int seg_parse(const char *name, struct seg_ent *e)
+{
+	char ext[8];
+	unsigned k;
+
+	if (sscanf(name, "%u-%llu-%llu.%7s", &e->no, &e->first, &e->last, ext) == 4) {
+		for (k = SEG_RAW; k <= SEG_TMP; k++)
+			if (!strcmp(ext, seg_ext[k])) {
+				e->kind = k;
+				return 0;
+			}
+	} else if (sscanf(name, "%u.%7s", &e->no, ext) == 2 && !strcmp(ext, "open")) {
+		e->kind = SEG_OPEN;
+		e->first = 0;
+		e->last = ULLONG_MAX;
+		return 0;
+	}
+	return -1;
+}
+
+static int seg_cmp(const void *a, const void *b)
+{
+	const struct seg_ent *x = a, *y = b;
+
+	if (x->no != y->no)
+		return x->no < y->no ? -1 : 1;
+	return (int)x->kind - (int)y->kind;
+}
+
+// the segments in d, by number (then kind); NULL if d cannot be read
+static struct seg_ent *seg_list(const char *d, size_t *n)
+{
+	struct seg_ent *v = NULL, *nv;
+	size_t cap = 0;
+	struct dirent *de;
+	DIR *dp = opendir(d);
+
+	*n = 0;
+	if (!dp)
+		return NULL;
+	while ((de = readdir(dp))) {
+		struct seg_ent e;
+
+		if (seg_parse(de->d_name, &e) < 0)
+			continue;
+		if (*n == cap) {
+			cap = cap ? 2 * cap : 64;
+			nv = realloc(v, cap * sizeof(*v));
+			if (!nv)
+				break;
+			v = nv;
+		}
+		v[(*n)++] = e;
+	}
+	closedir(dp);
+	if (!v)
+		v = malloc(sizeof(*v));
+	qsort(v, *n, sizeof(*v), seg_cmp);
+	return v;
+}
+
+// the rename and the unlinks of a segment, made durable
+static void dir_sync(void)
+{
+	if (dir_fd >= 0)
+		fsync(dir_fd);
+}
+
+/* compaction */
+
+static void roll_flush(struct acc *a, uint32_t id)
+{
+	struct jrec r = {
+		.ts = a->bucket * 1000000000ull, .id = id, .addr = a->addr,
+		.type = a->type, .status = (a->nt ? 1 : 0) | (a->nh ? 2 : 0),
+		.temp = a->nt ? a->t / a->nt : 0, .humi = a->nh ? a->h / a->nh : 0,
+	};
+
+	if (r.status)
+		journal_append(&out, &r);
+	memset(a, 0, sizeof(*a));
+}
+
+// failed readings are left out; sensors without an accumulator are
+// kept as they are
+static void roll_add(const struct jrec *r, void *arg)
+{
+	uint64_t bucket = r->ts / 1000000000u / cfg.rollup_s * cfg.rollup_s;
+	struct acc *a;
+	unsigned w;
+
+	(void)arg;
+	if (r->id >= cfg.nsensors) {
+		journal_append(&out, r);
+		return;
+	}
+	if (r->status <= 0)
+		return;
+	a = &acc[r->id * ACC_WAYS];
+	for (w = 0; w < ACC_WAYS; w++)
+		if ((a[w].nt || a[w].nh) && a[w].addr == r->addr && a[w].type == r->type)
+			break;
+	if (w == ACC_WAYS) {
+		// a free one, else the last one makes room
+		for (w = 0; w < ACC_WAYS - 1 && (a[w].nt || a[w].nh); w++)
+			;
+		if (a[w].nt || a[w].nh)
+			roll_flush(&a[w], r->id);
+	} else if (a[w].bucket != bucket) {
+		roll_flush(&a[w], r->id);
+	}
+	a += w;
+	a->bucket = bucket;
+	a->addr = r->addr;
+	a->type = r->type;
+	if (r->status & 0x01) {
+		a->t += r->temp;
+		a->nt++;
+	}
+	if (r->status & 0x02) {
+		a->h += r->humi;
+		a->nh++;
+	}
+}
+
+static void compact(const struct seg_ent *e)
+{
+	struct seg_ent tmp = *e, roll = *e;
+	char src[PATH_MAX], tpath[PATH_MAX], dst[PATH_MAX];
+	uint64_t good, size;
+	uint32_t i;
+
+	tmp.kind = SEG_TMP;
+	roll.kind = SEG_ROLL;
+	seg_name(src, e);
+	seg_name(tpath, &tmp);
+	seg_name(dst, &roll);
+	unlink(tpath);
+	// synced once, at the close, before it takes the place of the .raw
+	if (journal_open(&out, tpath, UINT32_MAX, 0) < 0)
+		return;
+	if (journal_scan(src, &good, &size, roll_add, NULL) < 0) {
+		fprintf(stderr, "Error: Could not read segment `%s': %s\n",
+			src, strerror(errno));
+		journal_close(&out);
+		unlink(tpath);
+		return;
+	}
+	for (i = 0; i < cfg.nsensors * ACC_WAYS; i++)
+		if (acc[i].nt || acc[i].nh)
+			roll_flush(&acc[i], i / ACC_WAYS);
+	journal_close(&out);
+	if (rename(tpath, dst) < 0) {
+		fprintf(stderr, "Error: Could not rename `%s': %s\n",
+			tpath, strerror(errno));
+		unlink(tpath);
+		return;
+	}
+	dir_sync();
+	unlink(src);
+}
+
+static void *compact_main(void *arg)
+{
+	(void)arg;
+	rt_helper_thread();
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		struct seg_ent e;
+
+		while (!qcount && !stopping)
+			pthread_cond_wait(&wake, &lock);
+		// what is queued gets done, also when stopping
+		if (!qcount)
+			break;
+		e = queue[qhead];
+		qhead = (qhead + 1) % STORE_QUEUE;
+		qcount--;
+		pthread_mutex_unlock(&lock);
+		compact(&e);
+		pthread_mutex_lock(&lock);
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+// a sealed segment to the compaction thread; if it is behind, the
+// segment stays raw until the store is opened next time
+static void compact_queue(const struct seg_ent *e)
+{
+	if (!cfg.rollup_s)
+		return;
+	pthread_mutex_lock(&lock);
+	if (qcount < STORE_QUEUE) {
+		queue[(qhead + qcount++) % STORE_QUEUE] = *e;
+		pthread_cond_signal(&wake);
+	} else {
+		backlog++;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+/* segments */
+
+static void span(const struct jrec *r, void *arg)
+{
+	uint64_t *mm = arg, ts = r->ts / 1000000000u;
+
+	if (ts < mm[0])
+		mm[0] = ts;
+	if (ts > mm[1])
+		mm[1] = ts;
+}
+
+// closes the open segment and renames it after its time span
+static void seal(void)
+{
+	struct seg_ent e = { seg_no, SEG_RAW, seg_min, seg_max };
+	char path[PATH_MAX];
+
+	journal_close(&seg);
+	// give back the preallocated blocks it did not use
+	if (truncate(seg_path, seg.size) < 0)
+		fprintf(stderr, "Error: Could not truncate segment `%s': %s\n",
+			seg_path, strerror(errno));
+	seg_name(path, &e);
+	if (rename(seg_path, path) < 0) {
+		fprintf(stderr, "Error: Could not seal segment `%s': %s\n",
+			seg_path, strerror(errno));
+	} else {
+		dir_sync();
+		compact_queue(&e);
+	}
+	seg_open = 0;
+}
+
+// the blocks for the whole segment at once: no allocation while
+// appending, and the segment lies in one piece on the disk; KEEP_SIZE,
+// so that the file still ends where the records do
+static void prealloc(void)
+{
+	if (fallocate(seg.fd, FALLOC_FL_KEEP_SIZE, 0, cfg.seal_bytes) < 0 &&
+	    errno != EOPNOTSUPP && errno != ENOSYS)
+		fprintf(stderr, "Error: Could not preallocate segment `%s': %s\n",
+			seg_path, strerror(errno));
+}
+
+static int open_segment(uint64_t ts)
+{
+	struct seg_ent e = { seg_next, SEG_OPEN, 0, 0 };
+
+	seg_name(seg_path, &e);
+	if (journal_open(&seg, seg_path, cfg.sync_n, cfg.sync_ms) < 0)
+		return -1;
+	prealloc();
+	seg_no = seg_next++;
+	seg_open = 1;
+	seg_first = seg_min = seg_max = ts;
+	return 0;
+}
+
+// appends to the segment a previous run left open (its torn tail cut);
+// store_append() seals it when it is due
+static int reopen_segment(const struct seg_ent *e)
+{
+	uint64_t mm[2] = { UINT64_MAX, 0 }, good, size;
+
+	seg_name(seg_path, e);
+	if (journal_scan(seg_path, &good, &size, span, mm) <= 0) {
+		unlink(seg_path);
+		return -1;
+	}
+	if (journal_open(&seg, seg_path, cfg.sync_n, cfg.sync_ms) < 0)
+		return -1;
+	prealloc();
+	seg_no = e->no;
+	seg_open = 1;
+	// the records are not in time order for sure; the oldest one
+	// starts the age
+	seg_first = seg_min = mm[0];
+	seg_max = mm[1];
+	return 0;
+}
+
+void store_append(const struct jrec *r)
+{
+	uint64_t ts = r->ts / 1000000000u;
+
+	// time goes by the readings, so a replay seals like the real run;
+	// a clock stepped back does not seal
+	if (seg_open &&
+	    (seg.size + seg.len + sizeof(struct journal_frame) + sizeof(*r) > cfg.seal_bytes ||
+	     (int64_t)(ts - seg_first) >= (int64_t)cfg.seal_s))
+		seal();
+	if (!seg_open && open_segment(ts) < 0)
+		return;
+	journal_append(&seg, r);
+	if (ts < seg_min)
+		seg_min = ts;
+	if (ts > seg_max)
+		seg_max = ts;
+}
+
+int store_commit(uint64_t now)
+{
+	return seg_open ? journal_commit(&seg, now) : 0;
+}
+
+uint64_t store_sync_due(void)
+{
+	return seg_open ? journal_sync_due(&seg) : 0;
+}
+
+// what the last run left behind: the open segment reopened, a finished
+// compaction cleaned up, the sealed raw ones queued
+static void recover(void)
+{
+	char path[PATH_MAX];
+	struct seg_ent *v;
+	size_t n, i;
+
+	v = seg_list(dir, &n);
+	for (i = 0; v && i < n; i++) {
+		struct seg_ent *e = &v[i];
+
+		seg_name(path, e);
+		if (e->no >= seg_next)
+			seg_next = e->no + 1;
+		if (e->kind == SEG_TMP) {
+			unlink(path);
+		} else if (e->kind == SEG_RAW) {
+			// sorted: the .roll of the same number comes next
+			if (i + 1 < n && v[i + 1].no == e->no && v[i + 1].kind == SEG_ROLL)
+				unlink(path);
+			else
+				compact_queue(e);
+		} else if (e->kind == SEG_OPEN) {
+			// there is only one, but should there be more, the
+			// newest stays open
+			if (seg_open)
+				seal();
+			reopen_segment(e);
+		}
+	}
+	dir_sync();
+	free(v);
+}
+
+int store_open(const char *path, const struct store_cfg *c)
+{
+	sigset_t all, old;
+
+	snprintf(dir, sizeof(dir), "%s", path);
+	cfg = *c;
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+		fprintf(stderr, "Error: Could not create store `%s': %s\n",
+			dir, strerror(errno));
+		return -1;
+	}
+	dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+	// the buffers now, so that rotation and compaction do not allocate;
+	// they outlive a close, for store_check()
+	if (!seg.buf)
+		seg.buf = arena_alloc(JOURNAL_BUF);
+	if (!out.buf)
+		out.buf = arena_alloc(JOURNAL_BUF);
+	acc = cfg.nsensors ? arena_alloc(cfg.nsensors * ACC_WAYS * sizeof(*acc)) : NULL;
+	if (dir_fd < 0 || !seg.buf || !out.buf || (cfg.nsensors && !acc)) {
+		fprintf(stderr, "Error: Could not open store `%s': %s\n",
+			dir, dir_fd < 0 ? strerror(errno) : "out of memory");
+		return -1;
+	}
+	if (!acc)
+		cfg.nsensors = 0;
+	// a second writer would append to the same .open at its own idea
+	// of the end, and recover and compact the same segments
+	if (flock(dir_fd, LOCK_EX | LOCK_NB) < 0) {
+		if (errno == EWOULDBLOCK)
+			fprintf(stderr, "Error: Store `%s' is in use by another process\n", dir);
+		else
+			fprintf(stderr, "Error: Could not lock store `%s': %s\n",
+				dir, strerror(errno));
+		close(dir_fd);
+		dir_fd = -1;
+		return -1;
+	}
+	stopping = 0;
+	backlog = 0;
+
+	recover();
+	if (!cfg.rollup_s)
+		return 0;
+	// signals stay with the threads that handle them
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	if (pthread_create(&compactor, NULL, compact_main, NULL)) {
+		pthread_sigmask(SIG_SETMASK, &old, NULL);
+		fprintf(stderr, "Error: Could not start the compaction thread\n");
+		return -1;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	comp_on = 1;
+	return 0;
+}
+
+// leaves the open segment to the next run (synced) and lets the
+// compaction finish its queue
+void store_close(void)
+{
+	if (seg_open)
+		journal_close(&seg);
+	seg_open = 0;
+	if (comp_on) {
+		pthread_mutex_lock(&lock);
+		stopping = 1;
+		pthread_cond_signal(&wake);
+		pthread_mutex_unlock(&lock);
+		pthread_join(compactor, NULL);
+		comp_on = 0;
+	}
+	if (backlog)
+		fprintf(stderr, "Store: compaction fell behind, %u segments left raw "
+			"until the next start\n", backlog);
+	if (dir_fd >= 0)
+		close(dir_fd);
+	dir_fd = -1;
+}
+
+/* readers */
+
+struct read_ctx {
+	uint64_t since;         ///< ns
+	long n;
+	void (*fn)(const struct jrec *r, void *arg);
+	void *arg;
+};
+
+static void read_one(const struct jrec *r, void *arg)
+{
+	struct read_ctx *c = arg;
+
+	if (r->ts >= c->since) {
+		c->fn(r, c->arg);
+		c->n++;
+	}
+}
+
+// a segment the compaction or the writer renamed since the listing:
+// the newest name of that number
+static int seg_find(const char *d, unsigned no, struct seg_ent *e)
+{
+	struct seg_ent *v;
+	size_t n, i;
+	int found = 0;
+
+	v = seg_list(d, &n);
+	for (i = 0; v && i < n; i++)
+		if (v[i].no == no && v[i].kind != SEG_TMP) {
+			*e = v[i];
+			found = 1;
+		}
+	free(v);
+	return found ? 0 : -1;
+}
+
+long store_read(const char *path, double hours,
+		void (*fn)(const struct jrec *r, void *arg), void *arg)
+{
+	struct read_ctx c = { 0, 0, fn, arg };
+	unsigned long long since_s = 0;
+	struct seg_ent *v;
+	size_t n, i;
+
+	if (hours > 0) {
+		since_s = time(NULL) - (time_t)(hours * 3600);
+		c.since = since_s * 1000000000ull;
+	}
+	snprintf(dir, sizeof(dir), "%s", path);
+	v = seg_list(dir, &n);
+	if (!v) {
+		fprintf(stderr, "Error: Could not read store `%s': %s\n",
+			dir, strerror(errno));
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		struct seg_ent e = v[i];
+		char name[PATH_MAX];
+		uint64_t good, size;
+		int tries;
+
+		// the index: only the segments that reach into the period
+		if (e.kind == SEG_TMP || e.last < since_s)
+			continue;
+		// a .raw whose .roll is in place already
+		if (e.kind == SEG_RAW && i + 1 < n && v[i + 1].no == e.no &&
+		    v[i + 1].kind == SEG_ROLL)
+			continue;
+		for (tries = 0; tries < 3; tries++) {
+			seg_name(name, &e);
+			if (journal_scan(name, &good, &size, read_one, &c) >= 0 ||
+			    errno != ENOENT || seg_find(dir, e.no, &e) < 0)
+				break;
+		}
+	}
+	free(v);
+	return c.n;
+}
+
+/* check */
+
+#define CHECK_T0            1800000000ull   ///< s, on a rollup boundary
+
+struct check_ctx {
+	unsigned rows, bad;
+};
+
+static void check_row(const struct jrec *r, void *arg)
+{
+	struct check_ctx *c = arg;
+
+	// the readings behind the seal, still in the open segment
+	if (r->ts >= (CHECK_T0 + 600) * 1000000000ull)
+		return;
+	c->rows++;
+	if (r->type == SENSOR_MCP9801 ?
+	    r->addr != 0x4f || r->status != 1 || r->temp != 20.0f :
+	    r->type != SENSOR_SHT30 || r->addr != 0x44 || r->status != 3 ||
+	    r->temp != 30.0f || r->humi != 50.0f)
+		c->bad++;
+}
+
+// ten readings a second apart from t, s
+static void check_run(uint8_t addr, uint8_t type, float temp, float humi, uint64_t t)
+{
+	struct jrec r = {
+		.id = 0, .addr = addr, .type = type, .status = humi ? 3 : 1,
+		.temp = temp, .humi = humi,
+	};
+	unsigned i;
+
+	for (i = 0; i < 10; i++) {
+		r.ts = (t + i) * 1000000000ull;
+		store_append(&r);
+	}
+}
+
+static void check_clean(const char *d)
+{
+	char path[PATH_MAX];
+	struct seg_ent *v;
+	size_t n, i;
+
+	snprintf(dir, sizeof(dir), "%s", d);
+	v = seg_list(dir, &n);
+	for (i = 0; v && i < n; i++) {
+		seg_name(path, &v[i]);
+		unlink(path);
+	}
+	free(v);
+	rmdir(d);
+}
+
+// Three short runs into one segment, as from cron: MCP9801, SHT30 and
+// MCP9801 again, all as sensor 0 in one rollup bucket; the rollup must
+// keep one mean per sensor and not mix them
+int store_check(FILE *f, const char *d)
+{
+	static const struct store_cfg c = {
+		.seal_bytes = 1 << 20, .seal_s = 600, .rollup_s = 60, .nsensors = 1,
+	};
+	struct check_ctx k = { 0, 0 };
+	char path[PATH_MAX / 2];
+
+	snprintf(path, sizeof(path), "%s/room_temp-check.store", d);
+	check_clean(path);
+	if (store_open(path, &c) < 0)
+		return 1;
+	check_run(0x4f, SENSOR_MCP9801, 20.0f, 0, CHECK_T0);
+	store_close();
+	if (store_open(path, &c) < 0)
+		return 1;
+	check_run(0x44, SENSOR_SHT30, 30.0f, 50.0f, CHECK_T0 + 10);
+	store_close();
+	if (store_open(path, &c) < 0)
+		return 1;
+	check_run(0x4f, SENSOR_MCP9801, 20.0f, 0, CHECK_T0 + 20);
+	// past the age limit: seals the segment, the compaction rolls it up
+	check_run(0x4f, SENSOR_MCP9801, 20.0f, 0, CHECK_T0 + 1200);
+	store_close();
+	store_read(path, 0, check_row, &k);
+	check_clean(path);
+	if (k.rows != 2 || k.bad) {
+		fprintf(f, "%-14s FAILED: %u rollups, %u of them mixed\n",
+			"shared segment", k.rows, k.bad);
+		return 1;
+	}
+	fprintf(f, "%-14s ok\n", "shared segment");
+	return 0;
+}
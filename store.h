@@ -0,0 +1,45 @@
+/* ---------------------------------------------------------------------
+ *                           store.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Segmented on-disk storage of readings: preallocated
+ *              journal segments, sealed at a size/time limit and rolled
+ *              up by a background compaction thread
+ * --------------------------------------------------------------------*/
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "journal.h"
+
+struct store_cfg {
+	uint64_t seal_bytes;    ///< segment size limit, preallocated
+	uint32_t seal_s;        ///< segment time limit (reading timestamps)
+	uint32_t rollup_s;      ///< compaction buckets, 0: keep raw segments
+	uint32_t sync_n;        ///< group commit, as struct journal
+	uint32_t sync_ms;
+	uint32_t nsensors;      ///< ids rolled up (others are kept as they are)
+};
+
+int store_open(const char *dir, const struct store_cfg *cfg);
+void store_append(const struct jrec *r);
+int store_commit(uint64_t now);
+uint64_t store_sync_due(void);      ///< monotonic ns, 0: nothing to sync
+void store_close(void);
+
+// calls fn for the records of the last hours (0: all), oldest segment
+// first; returns the records, -1 if dir cannot be read
+long store_read(const char *dir, double hours,
+		void (*fn)(const struct jrec *r, void *arg), void *arg);
+
+// short runs of different sensors into one segment of a scratch store
+// in dir, as from cron, and their rollups; returns how many failed
+int store_check(FILE *f, const char *dir);
+
+#endif /* STORE_H */
@@ -0,0 +1,24 @@
+#!/bin/sh
+#
+# Copyright (c) 2026 Ivaylo Haratcherev
+# All Rights Reserved
+#
+# @brief	Mean exec-to-exit time of a command
+# @file		exec_bench.sh
+# @note		Usage: exec_bench.sh RUNS command [args...]
+#		The command output is discarded. The shell fork/wait cost
+#		is included, so compare numbers taken on the same box only.
+#
+
+runs=$1
+shift
+
+i=0
+start=$(date +%s%N)
+while [ $i -lt "$runs" ]; do
+	"$@" >/dev/null 2>&1
+	i=$((i + 1))
+done
+end=$(date +%s%N)
+
+echo "$* : $(( (end - start) / runs / 1000 )) us/exec ($runs runs)"
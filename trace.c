@@ -0,0 +1,288 @@
+/* ---------------------------------------------------------------------
+ *                           trace.c
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Bus transcripts. While recording, every transaction
+ *              the drivers do (address, operation, command, result,
+ *              bytes moved) is appended to a text file, one per line,
+ *              with its CLOCK_REALTIME timestamp:
+ *
+ *                # ts_ns addr op cmd result [data...]
+ *                1760620000123456789 0x44 mark
+ *                1760620000123470001 0x44 write_byte_data 0x24 0 00
+ *                1760620000138612345 0x44 read_block 0x00 6 63 9a 1f 7b e1 a0
+ *
+ *              A replay loads the transcript and answers the drivers'
+ *              transactions from it, in order, without any hardware,
+ *              sleeps or schedule. Time is replayed too, so that
+ *              filters and windows see the recorded timestamps.
+ *              "mark" starts a reading; a replay that runs out of
+ *              transactions rewinds to the first one.
+ * --------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "latency.h"
+#include "trace.h"
+
+#define TRACE_MARK          0
+
+static const char *op_names[] = {
+	[TRACE_MARK]               = "mark",
+	[PROBE_OP_READ_BYTE]       = "read_byte",
+	[PROBE_OP_WRITE_BYTE]      = "write_byte",
+	[PROBE_OP_READ_BYTE_DATA]  = "read_byte_data",
+	[PROBE_OP_WRITE_BYTE_DATA] = "write_byte_data",
+	[PROBE_OP_READ_WORD_DATA]  = "read_word_data",
+	[PROBE_OP_READ_BLOCK]      = "read_block",
+	[PROBE_OP_WRITE_BLOCK]     = "write_block",
+};
+#define TRACE_OPS   (sizeof(op_names) / sizeof(op_names[0]))
+
+struct trace_ent {
+	uint64_t ts;
+	int32_t res;
+	uint8_t addr;
+	uint8_t op;
+	uint8_t cmd;
+	uint8_t len;
+	uint8_t data[TRACE_DATA_MAX];
+	unsigned line;              ///< in the transcript, for messages
+};
+
+int trace_mode;
+
+static FILE *trace_out;
+
+static struct trace_ent *ents;
+static size_t nents, pos;
+static size_t first_mark = SIZE_MAX;
+static uint64_t mark_period;        ///< mean time between readings
+static uint64_t shift;              ///< added to timestamps after rewinds
+static int failed;
+static uint32_t readings;
+static uint64_t replay_t0;
+
+static uint64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+int trace_record_open(const char *path)
+{
+	trace_out = fopen(path, "w");
+	if (!trace_out) {
+		fprintf(stderr, "Error: Could not open transcript `%s': %s\n",
+			path, strerror(errno));
+		return -1;
+	}
+	fprintf(trace_out, "# room_temp bus transcript\n"
+		"# ts_ns addr op cmd result [data...]\n");
+	trace_mode = TRACE_RECORD;
+	return 0;
+}
+
+static int parse_line(struct trace_ent *e, char *line)
+{
+	char op[24], *p;
+	int n, i = 0, addr, cmd = 0;
+
+	n = sscanf(line, "%" SCNu64 " %i %23s %i %" SCNi32 " %n",
+		   &e->ts, &addr, op, &cmd, &e->res, &i);
+	if (n < 3)
+		return -1;
+	for (e->op = 0; e->op < TRACE_OPS; e->op++)
+		if (op_names[e->op] && !strcmp(op, op_names[e->op]))
+			break;
+	if (e->op == TRACE_OPS || (e->op != TRACE_MARK && n < 5))
+		return -1;
+	e->addr = addr;
+	e->cmd = cmd;
+	e->len = 0;
+	if (e->op == TRACE_MARK)
+		return 0;
+	for (p = line + i; *p && *p != '\n'; ) {
+		char *end;
+		unsigned long b = strtoul(p, &end, 16);
+
+		if (end == p || b > 0xff || e->len == TRACE_DATA_MAX)
+			return -1;
+		e->data[e->len++] = b;
+		for (p = end; *p == ' ' || *p == '\t'; p++)
+			;
+	}
+	return 0;
+}
+
+int trace_replay_open(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[256];
+	size_t cap = 0, nmarks = 0, last_mark = 0;
+	unsigned lineno = 0;
+
+	if (!f) {
+		fprintf(stderr, "Error: Could not open transcript `%s': %s\n",
+			path, strerror(errno));
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (nents == cap) {
+			struct trace_ent *n = realloc(ents, (cap ? cap * 2 : 1024) * sizeof(*n));
+
+			if (!n) {
+				fprintf(stderr, "Error: out of memory\n");
+				fclose(f);
+				return -1;
+			}
+			ents = n;
+			cap = cap ? cap * 2 : 1024;
+		}
+		if (parse_line(&ents[nents], line) < 0) {
+			fprintf(stderr, "Error: %s:%u: malformed transcript line\n",
+				path, lineno);
+			fclose(f);
+			return -1;
+		}
+		ents[nents].line = lineno;
+		if (ents[nents].op == TRACE_MARK) {
+			if (first_mark == SIZE_MAX)
+				first_mark = nents;
+			last_mark = nents;
+			nmarks++;
+		}
+		nents++;
+	}
+	fclose(f);
+	if (nmarks == 0) {
+		fprintf(stderr, "Error: %s: no readings in transcript\n", path);
+		return -1;
+	}
+	mark_period = nmarks > 1 ?
+		(ents[last_mark].ts - ents[first_mark].ts) / (nmarks - 1) :
+		1000000000u;
+	trace_mode = TRACE_REPLAY;
+	replay_t0 = lat_now();
+	return 0;
+}
+
+void trace_close(void)
+{
+	if (trace_out)
+		fclose(trace_out);
+	trace_out = NULL;
+	free(ents);
+	ents = NULL;
+	nents = pos = 0;
+	trace_mode = 0;
+}
+
+void trace_mark(int addr)
+{
+	if (trace_mode == TRACE_RECORD) {
+		// the previous reading is complete, so this is a good
+		// point to push it out
+		fflush(trace_out);
+		fprintf(trace_out, "%" PRIu64 " 0x%02x %s\n",
+			trace_now(), addr, op_names[TRACE_MARK]);
+	} else if (trace_mode == TRACE_REPLAY && !failed && pos < nents) {
+		if (ents[pos].op != TRACE_MARK || ents[pos].addr != addr) {
+			fprintf(stderr, "Error: transcript line %u has %s 0x%02x @0x%02x, "
+				"driver started a reading @0x%02x\n", ents[pos].line,
+				op_names[ents[pos].op], ents[pos].cmd, ents[pos].addr, addr);
+			failed = 1;
+			return;
+		}
+		pos++;
+		readings++;
+	}
+}
+
+void trace_xfer(int addr, enum probe_op op, uint8_t cmd, uint8_t len,
+		const uint8_t *wr, const uint8_t *rd, int32_t res)
+{
+	const uint8_t *data = wr ? wr : rd;
+	unsigned i;
+
+	if (trace_mode != TRACE_RECORD)
+		return;
+	if (op == PROBE_OP_READ_BLOCK)
+		len = res < 0 ? 0 : res < len ? res : len;
+	fprintf(trace_out, "%" PRIu64 " 0x%02x %s 0x%02x %" PRId32,
+		trace_now(), addr, op_names[op], cmd, res);
+	for (i = 0; i < len; i++)
+		fprintf(trace_out, " %02x", data[i]);
+	fputc('\n', trace_out);
+}
+
+static const char *op_name(unsigned op)
+{
+	return op < TRACE_OPS && op_names[op] ? op_names[op] : "?";
+}
+
+int32_t trace_replay(int addr, enum probe_op op, uint8_t cmd, uint8_t len,
+		     const uint8_t *wr, uint8_t *rd)
+{
+	const struct trace_ent *e;
+
+	if (failed || pos >= nents)
+		return -EIO;
+	e = &ents[pos];
+	if (e->addr != addr || e->op != op || e->cmd != cmd ||
+	    (wr && (e->len != len || memcmp(e->data, wr, len)))) {
+		fprintf(stderr, "Error: transcript line %u has %s 0x%02x @0x%02x, "
+			"driver did %s 0x%02x @0x%02x\n", e->line,
+			op_name(e->op), e->cmd, e->addr, op_name(op), cmd, addr);
+		failed = 1;
+		return -EIO;
+	}
+	pos++;
+	if (rd && e->res > 0)
+		memcpy(rd, e->data, e->len < len ? e->len : len);
+	return e->res;
+}
+
+// CLOCK_REALTIME as recorded: the timestamp of the last transaction
+// replayed (of the first one before the replay starts)
+uint64_t trace_time(void)
+{
+	if (nents == 0)
+		return 0;
+	return ents[pos ? pos - 1 : 0].ts + shift;
+}
+
+// 0 while there are transactions left, 1 at the end, -1 on a mismatch
+int trace_replay_end(void)
+{
+	if (failed)
+		return -1;
+	return pos >= nents;
+}
+
+// back to the first reading, time goes on
+void trace_rewind(void)
+{
+	shift += ents[nents - 1].ts - ents[first_mark].ts + mark_period;
+	pos = first_mark;
+}
+
+void trace_report(FILE *f)
+{
+	double dt = (lat_now() - replay_t0) / 1e9;
+
+	fprintf(f, "Replayed %u readings in %.3f s (%.0f readings/s)\n",
+		readings, dt, dt > 0 ? readings / dt : 0.0);
+}
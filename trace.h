@@ -0,0 +1,42 @@
+/* ---------------------------------------------------------------------
+ *                           trace.h
+ * ---------------------------------------------------------------------
+ *
+ * Copyright (c) 2026 Ivaylo Haratcherev
+ * All Rights Reserved
+ *
+ * DESCRIPTION: Recording of the bus transactions into a transcript,
+ *              and their replay without hardware
+ * --------------------------------------------------------------------*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "probes.h"
+
+#define TRACE_DATA_MAX      32      ///< longest SMBus block
+
+int trace_record_open(const char *path);
+int trace_replay_open(const char *path);
+void trace_close(void);
+
+extern int trace_mode;              ///< 0 off, TRACE_RECORD or TRACE_REPLAY
+#define TRACE_RECORD        1
+#define TRACE_REPLAY        2
+
+// start of a reading; also where a replay restarts after a rewind
+void trace_mark(int addr);
+void trace_xfer(int addr, enum probe_op op, uint8_t cmd, uint8_t len,
+		const uint8_t *wr, const uint8_t *rd, int32_t res);
+int32_t trace_replay(int addr, enum probe_op op, uint8_t cmd, uint8_t len,
+		     const uint8_t *wr, uint8_t *rd);
+
+uint64_t trace_time(void);
+int trace_replay_end(void);
+void trace_rewind(void);
+void trace_report(FILE *f);
+
+#endif /* TRACE_H */